@@ -0,0 +1,541 @@
+/*
+* Kernel microbenchmarks. Build from the repository root with
+*
+*   gcc -O2 -pthread -DHUFFMAN_NO_MAIN -o kernelbench bench/kernelbench.c src/compression.c src/huffman.c src/blockindex.c src/daemon.c src/archive.c src/cpu.c src/checksum.c src/token.c src/parallel.c src/bwt.c
+*
+* and run as
+*
+*   ./kernelbench [-d corpusDir] [-s saveBaseline] [-b compareBaseline] [-t tolerancePercent]
+*
+* Each kernel is timed on synthetic distributions and on every file of the
+* corpus directory. Cycles, branch misses and cache misses are read from
+* perf_event when the kernel allows it; otherwise only wall time is reported.
+* Run with HUFFMAN_CPU=scalar to time the portable kernels on the same host.
+* When comparing, a kernel whose cycles per unit exceed the tolerance fails.
+* Wall time alone is too noisy to gate on, so without cycles in both runs a
+* slower kernel is only reported as a warning.
+*/
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "../src/compression.h"
+
+#define BENCH_REPETITIONS 5
+#define BENCH_MIN_UNITS (1 << 22)
+#define BENCH_MAX_TREE_ITERATIONS 1024
+#define BENCH_MAX_LOOKUPS (1 << 16)
+#define BENCH_SYNTHETIC_LENGTH (1 << 20)
+#define BENCH_MAX_RESULTS 256
+
+/*
+* Struct definitions
+*/
+typedef struct BenchInput {
+    char name[64];
+    char *text;
+    int length;
+} BenchInput;
+
+typedef struct BenchState {
+    BenchInput *input;
+    CodeList *codeList;
+    int *charDict;
+    char *compressed;
+    int compressedSize;
+    char *output;
+    CodeList **heaps;
+    CodeNode **trees;
+    int iterations;
+    int checksum;
+} BenchState;
+
+typedef struct BenchKernel {
+    char *name;
+    long long (*units)(BenchState *);
+    void (*prepare)(BenchState *);
+    void (*run)(BenchState *);
+    void (*release)(BenchState *);
+} BenchKernel;
+
+typedef struct Measurement {
+    char input[64];
+    char kernel[32];
+    double nanos;
+    double cycles;
+    double branchMisses;
+    double cacheMisses;
+} Measurement;
+
+typedef struct Counters {
+    int fds[3];
+    int available;
+} Counters;
+
+/*
+* Kernel declarations
+*/
+void charFrequency(char *, int, int *);
+CodeList * textToCharCodes(char *, int);
+CodeList * buildHuffmanHeap(CodeList *);
+CodeNode * buildHuffmanTree(CodeList *);
+int * treeToCharDict(CodeNode *);
+void freeHuffmanTree(CodeNode *);
+int findCompressedTextSize(int *, char *, int);
+int compressText(int *, char *, int, char *, int);
+int decompressText(unsigned char *, int, int, int *, char *, int);
+int findKeyFromCode(int *, int);
+
+/*
+* Function declarations
+*/
+void openCounters(Counters *);
+void startCounters(Counters *);
+void stopCounters(Counters *, long long *);
+void closeCounters(Counters *);
+double nowNanos(void);
+unsigned int nextRandom(void);
+void generateUniform(BenchInput *);
+void generateSkewed(BenchInput *);
+void generateSingle(BenchInput *);
+int loadCorpus(char *, BenchInput *, int);
+void prepareState(BenchState *, BenchInput *);
+void releaseState(BenchState *);
+void measureKernel(Counters *, BenchKernel *, BenchState *, Measurement *);
+void printMeasurement(Measurement *, int);
+void saveBaseline(char *, Measurement *, int);
+int compareBaseline(char *, Measurement *, int, double);
+long long bytesUnits(BenchState *);
+long long treeUnits(BenchState *);
+long long lookupUnits(BenchState *);
+void noPrepare(BenchState *);
+void noRelease(BenchState *);
+void runCharFrequency(BenchState *);
+void prepareTrees(BenchState *);
+void runBuildHuffmanTree(BenchState *);
+void releaseTrees(BenchState *);
+void runCompressText(BenchState *);
+void runDecompressText(BenchState *);
+void runFindKeyFromCode(BenchState *);
+
+unsigned int benchSeed = 12345;
+
+BenchKernel kernels[] = {
+    {"charFrequency", bytesUnits, noPrepare, runCharFrequency, noRelease},
+    {"buildHuffmanTree", treeUnits, prepareTrees, runBuildHuffmanTree, releaseTrees},
+    {"compressText", bytesUnits, noPrepare, runCompressText, noRelease},
+    {"decompressText", bytesUnits, noPrepare, runDecompressText, noRelease},
+    {"findKeyFromCode", lookupUnits, noPrepare, runFindKeyFromCode, noRelease},
+};
+
+
+/*
+* Function definitions
+*/
+int main(int argc, char **argv) {
+    char *corpus = "cantrbry";
+    char *savePath = NULL;
+    char *baselinePath = NULL;
+    double tolerance = 10.0;
+    BenchInput inputs[64];
+    Measurement results[BENCH_MAX_RESULTS];
+    Counters counters;
+    int inputCount = 0;
+    int resultCount = 0;
+    int kernelCount = sizeof(kernels) / sizeof(kernels[0]);
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        if(strcmp(argv[i], "-d") == 0) corpus = argv[i + 1];
+        else if(strcmp(argv[i], "-s") == 0) savePath = argv[i + 1];
+        else if(strcmp(argv[i], "-b") == 0) baselinePath = argv[i + 1];
+        else if(strcmp(argv[i], "-t") == 0) tolerance = atof(argv[i + 1]);
+        else {
+            printf("Invalid Arguments\n");
+            return 2;
+        }
+    }
+
+    generateUniform(inputs + inputCount++);
+    generateSkewed(inputs + inputCount++);
+    generateSingle(inputs + inputCount++);
+    inputCount += loadCorpus(corpus, inputs + inputCount, 64 - inputCount);
+
+    openCounters(&counters);
+    if(!counters.available) printf("perf_event unavailable, reporting wall time only\n");
+    printf("kernels: bmi2 %d lzcnt %d\n", cpuKernels()->bmi2, cpuKernels()->lzcnt);
+
+    for(int i = 0; i < inputCount; i++) {
+        BenchState state;
+        prepareState(&state, inputs + i);
+
+        for(int k = 0; k < kernelCount && resultCount < BENCH_MAX_RESULTS; k++) {
+            measureKernel(&counters, kernels + k, &state, results + resultCount);
+            printMeasurement(results + resultCount, counters.available);
+            resultCount += 1;
+        }
+
+        releaseState(&state);
+        free(inputs[i].text);
+    }
+    closeCounters(&counters);
+
+    if(savePath != NULL) saveBaseline(savePath, results, resultCount);
+    if(baselinePath != NULL) return compareBaseline(baselinePath, results, resultCount, tolerance);
+    return 0;
+}
+
+#ifdef __linux__
+int openCounter(unsigned int, unsigned long long, int);
+
+int openCounter(unsigned int type, unsigned long long config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+void openCounters(Counters *counters) {
+    counters->fds[0] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    counters->fds[1] = -1;
+    counters->fds[2] = -1;
+    counters->available = counters->fds[0] != -1;
+    if(!counters->available) return;
+
+    counters->fds[1] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, counters->fds[0]);
+    counters->fds[2] = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, counters->fds[0]);
+    if(counters->fds[1] == -1 || counters->fds[2] == -1) {
+        closeCounters(counters);
+        counters->available = 0;
+    }
+}
+
+void startCounters(Counters *counters) {
+    if(!counters->available) return;
+    ioctl(counters->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void stopCounters(Counters *counters, long long *values) {
+    unsigned long long group[4] = {0};
+    memset(values, 0, sizeof(long long) * 3);
+    if(!counters->available) return;
+
+    ioctl(counters->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    if(read(counters->fds[0], group, sizeof(group)) < (long) sizeof(group)) return;
+    for(int i = 0; i < 3; i++) values[i] = (long long) group[i + 1];
+}
+
+void closeCounters(Counters *counters) {
+    for(int i = 2; i >= 0; i--) {
+        if(counters->fds[i] != -1) close(counters->fds[i]);
+        counters->fds[i] = -1;
+    }
+}
+#else
+void openCounters(Counters *counters) {
+    counters->available = 0;
+}
+
+void startCounters(Counters *counters) {
+}
+
+void stopCounters(Counters *counters, long long *values) {
+    memset(values, 0, sizeof(long long) * 3);
+}
+
+void closeCounters(Counters *counters) {
+}
+#endif
+
+double nowNanos(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+unsigned int nextRandom(void) {
+    benchSeed = benchSeed * 1103515245 + 12345;
+    return benchSeed >> 8;
+}
+
+void generateUniform(BenchInput *input) {
+    strcpy(input->name, "uniform");
+    input->length = BENCH_SYNTHETIC_LENGTH;
+    input->text = malloc(sizeof(char) * input->length);
+    for(int i = 0; i < input->length; i++) input->text[i] = (char) nextRandom();
+}
+
+/*
+* Symbol k appears with probability 2^-(k+1), which gives long code tails.
+*/
+void generateSkewed(BenchInput *input) {
+    strcpy(input->name, "skewed");
+    input->length = BENCH_SYNTHETIC_LENGTH;
+    input->text = malloc(sizeof(char) * input->length);
+    for(int i = 0; i < input->length; i++) {
+        unsigned int value = nextRandom() | (1 << 20);
+        input->text[i] = (char) ('a' + __builtin_ctz(value));
+    }
+}
+
+void generateSingle(BenchInput *input) {
+    strcpy(input->name, "single");
+    input->length = BENCH_SYNTHETIC_LENGTH;
+    input->text = malloc(sizeof(char) * input->length);
+    memset(input->text, 'a', sizeof(char) * input->length);
+}
+
+int loadCorpus(char *directory, BenchInput *inputs, int maxInputs) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry = NULL;
+    char path[1024];
+    int count = 0;
+
+    if(dir == NULL) {
+        printf("Corpus directory %s not found, using synthetic inputs only\n", directory);
+        return 0;
+    }
+
+    while((entry = readdir(dir)) != NULL && count < maxInputs) {
+        if(entry->d_name[0] == '.') continue;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+
+        int length = 0;
+        char *text = readFromFile(path, &length);
+        if(text == NULL) continue;
+        if(length == 0) {
+            free(text);
+            continue;
+        }
+
+        snprintf(inputs[count].name, sizeof(inputs[count].name), "%.63s", entry->d_name);
+        inputs[count].text = text;
+        inputs[count].length = length;
+        count += 1;
+    }
+
+    closedir(dir);
+    return count;
+}
+
+void prepareState(BenchState *state, BenchInput *input) {
+    CodeList *heap = NULL;
+    CodeNode *root = NULL;
+
+    memset(state, 0, sizeof(BenchState));
+    state->input = input;
+    state->codeList = textToCharCodes(input->text, input->length);
+
+    heap = buildHuffmanHeap(duplicateCodeList(state->codeList));
+    root = buildHuffmanTree(heap);
+    state->charDict = treeToCharDict(root);
+    freeHuffmanTree(root);
+    freeCodeList(heap);
+
+    state->compressedSize = findCompressedTextSize(state->charDict, input->text, input->length);
+    state->compressed = calloc(state->compressedSize + READ_PADDING, sizeof(char));
+    compressText(state->charDict, input->text, input->length, state->compressed, 0);
+    state->output = malloc(sizeof(char) * input->length);
+}
+
+void releaseState(BenchState *state) {
+    freeCodeList(state->codeList);
+    free(state->charDict);
+    free(state->compressed);
+    free(state->output);
+}
+
+/*
+* Repeats the kernel until it has processed BENCH_MIN_UNITS units and keeps
+* the fastest of BENCH_REPETITIONS runs.
+*/
+void measureKernel(Counters *counters, BenchKernel *kernel, BenchState *state, Measurement *result) {
+    long long units = kernel->units(state);
+    long long values[3];
+    int iterations = (int) (BENCH_MIN_UNITS / units) + 1;
+
+    if(kernel->units == treeUnits && iterations > BENCH_MAX_TREE_ITERATIONS) iterations = BENCH_MAX_TREE_ITERATIONS;
+    state->iterations = iterations;
+
+    snprintf(result->input, sizeof(result->input), "%s", state->input->name);
+    snprintf(result->kernel, sizeof(result->kernel), "%s", kernel->name);
+    result->nanos = -1;
+
+    for(int r = 0; r < BENCH_REPETITIONS; r++) {
+        kernel->prepare(state);
+
+        double start = nowNanos();
+        startCounters(counters);
+        kernel->run(state);
+        stopCounters(counters, values);
+        double elapsed = nowNanos() - start;
+
+        kernel->release(state);
+
+        double total = (double) units * iterations;
+        if(result->nanos < 0 || elapsed / total < result->nanos) {
+            result->nanos = elapsed / total;
+            result->cycles = values[0] / total;
+            result->branchMisses = values[1] / total;
+            result->cacheMisses = values[2] / total;
+        }
+    }
+}
+
+void printMeasurement(Measurement *result, int withCounters) {
+    printf("%-16s %-18s %10.3f ns/unit", result->input, result->kernel, result->nanos);
+    if(withCounters) {
+        printf(" %10.3f cycles/unit %8.4f br-miss/unit %8.4f cache-miss/unit", result->cycles, result->branchMisses, result->cacheMisses);
+    }
+    printf("\n");
+}
+
+void saveBaseline(char *filename, Measurement *results, int count) {
+    FILE *file = fopen(filename, "w");
+    if(file == NULL) {
+        printf("Error while opening file %s\n", filename);
+        return;
+    }
+
+    for(int i = 0; i < count; i++) {
+        fprintf(file, "%s %s %.6f %.6f\n", results[i].input, results[i].kernel, results[i].nanos, results[i].cycles);
+    }
+    fclose(file);
+}
+
+/*
+* Returns 1 if any kernel regressed beyond the tolerance in cycles, 0
+* otherwise.
+*/
+int compareBaseline(char *filename, Measurement *results, int count, double tolerance) {
+    FILE *file = fopen(filename, "r");
+    char input[64];
+    char kernel[32];
+    double nanos = 0;
+    double cycles = 0;
+    int failed = 0;
+
+    if(file == NULL) {
+        printf("Error while opening file %s\n", filename);
+        return 1;
+    }
+
+    while(fscanf(file, "%63s %31s %lf %lf", input, kernel, &nanos, &cycles) == 4) {
+        for(int i = 0; i < count; i++) {
+            if(strcmp(results[i].input, input) != 0 || strcmp(results[i].kernel, kernel) != 0) continue;
+
+            int useCycles = cycles > 0 && results[i].cycles > 0;
+            double before = useCycles ? cycles : nanos;
+            double after = useCycles ? results[i].cycles : results[i].nanos;
+
+            if(after <= before * (1 + tolerance / 100)) continue;
+            if(useCycles) {
+                printf("REGRESSION %s %s: %.3f -> %.3f cycles/unit\n", input, kernel, before, after);
+                failed = 1;
+            } else {
+                printf("WARNING %s %s: %.3f -> %.3f ns/unit, no cycle counts to confirm\n", input, kernel, before, after);
+            }
+        }
+    }
+
+    fclose(file);
+    return failed;
+}
+
+long long bytesUnits(BenchState *state) {
+    return state->input->length;
+}
+
+long long treeUnits(BenchState *state) {
+    return state->codeList->size;
+}
+
+long long lookupUnits(BenchState *state) {
+    return state->input->length < BENCH_MAX_LOOKUPS ? state->input->length : BENCH_MAX_LOOKUPS;
+}
+
+void noPrepare(BenchState *state) {
+}
+
+void noRelease(BenchState *state) {
+}
+
+void runCharFrequency(BenchState *state) {
+    int charDict[256];
+
+    for(int i = 0; i < state->iterations; i++) {
+        memset(charDict, 0, sizeof(charDict));
+        charFrequency(state->input->text, state->input->length, charDict);
+        state->checksum += charDict[i & 255];
+    }
+}
+
+/*
+* Heaps are built before the counters start so only tree construction is
+* measured.
+*/
+void prepareTrees(BenchState *state) {
+    state->heaps = malloc(sizeof(CodeList *) * state->iterations);
+    state->trees = malloc(sizeof(CodeNode *) * state->iterations);
+    for(int i = 0; i < state->iterations; i++) {
+        state->heaps[i] = buildHuffmanHeap(duplicateCodeList(state->codeList));
+    }
+}
+
+void runBuildHuffmanTree(BenchState *state) {
+    for(int i = 0; i < state->iterations; i++) {
+        state->trees[i] = buildHuffmanTree(state->heaps[i]);
+    }
+}
+
+void releaseTrees(BenchState *state) {
+    for(int i = 0; i < state->iterations; i++) {
+        freeHuffmanTree(state->trees[i]);
+        freeCodeList(state->heaps[i]);
+    }
+    free(state->trees);
+    free(state->heaps);
+}
+
+void runCompressText(BenchState *state) {
+    char *buffer = malloc(sizeof(char) * (state->compressedSize + 1));
+
+    for(int i = 0; i < state->iterations; i++) {
+        compressText(state->charDict, state->input->text, state->input->length, buffer, 0);
+        state->checksum += buffer[0];
+    }
+    free(buffer);
+}
+
+void runDecompressText(BenchState *state) {
+    for(int i = 0; i < state->iterations; i++) {
+        decompressText((unsigned char *) state->compressed, state->compressedSize, 0, state->charDict, state->output, state->input->length);
+        state->checksum += state->output[0];
+    }
+}
+
+void runFindKeyFromCode(BenchState *state) {
+    int lookups = (int) lookupUnits(state);
+
+    for(int i = 0; i < state->iterations; i++) {
+        for(int j = 0; j < lookups; j++) {
+            int key = (unsigned char) state->input->text[j];
+            state->checksum += findKeyFromCode(state->charDict, state->charDict[key]);
+        }
+    }
+}
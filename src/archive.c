@@ -0,0 +1,445 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "compression.h"
+#include "archive.h"
+
+/*
+* Kernel declarations
+*/
+CodeList * textToCharCodes(char *, int);
+int * codeListToCharDict(CodeList *);
+int compressDictionaryCode(char *, int, int, int);
+int decompressDictionaryCode(unsigned char *, int);
+
+/*
+* Function declarations
+*/
+int appendArchiveEntry(FILE *, ArchiveEntry *, char *, int);
+int writeArchiveDirectory(FILE *, ArchiveDirectory *);
+int parseArchiveDirectory(ArchiveDirectory *, unsigned char *, int, int);
+char * archiveEntryName(char *);
+int validEntryName(char *);
+char * joinPath(char *, char *);
+int makeParentDirectories(char *);
+int writeEntryFile(char *, char *, int);
+void extractEntry(void *, int);
+
+
+/*
+* Function definitions
+*/
+
+/*
+* Compresses every input as its own segment, then writes the directory and
+* trailer. Returns the number of entries that could not be added. A failed
+* write removes the archive and counts every input as failed.
+*/
+int createArchive(char *archive, char **inputs, int count) {
+    FILE *output = fopen(archive, "wb");
+    ArchiveDirectory directory = {malloc(sizeof(ArchiveEntry) * (count > 0 ? count : 1)), 0, 0};
+    int failures = 0;
+    int written = 1;
+
+    if(output == NULL) {
+        printf("Error while opening file %s\n", archive);
+        free(directory.entries);
+        return count;
+    }
+
+    for(int i = 0; i < count && written; i++) {
+        char *name = archiveEntryName(inputs[i]);
+        int length = 0;
+        char *text = NULL;
+
+        if(!validEntryName(name)) {
+            printf("Invalid entry name %s\n", inputs[i]);
+            failures += 1;
+            continue;
+        }
+        if(findArchiveEntry(&directory, name) != -1) {
+            printf("Duplicate entry name %s\n", inputs[i]);
+            failures += 1;
+            continue;
+        }
+        if((text = readFromFile(inputs[i], &length)) == NULL) {
+            failures += 1;
+            continue;
+        }
+
+        ArchiveEntry *entry = directory.entries + directory.size;
+        int size = appendArchiveEntry(output, entry, text, length);
+        free(text);
+        if(size == -1) {
+            written = 0;
+            break;
+        }
+
+        entry->name = strdup(name);
+        entry->offset = directory.end;
+        directory.end += size;
+        directory.size += 1;
+    }
+
+    if(written && writeArchiveDirectory(output, &directory) == -1) written = 0;
+    if(fclose(output) != 0) written = 0;
+    if(!written) {
+        printf("Failed to write %s\n", archive);
+        remove(archive);
+        failures = count > 0 ? count : 1;
+    }
+
+    for(int i = 0; i < directory.size; i++) free(directory.entries[i].name);
+    free(directory.entries);
+    return failures;
+}
+
+/*
+* Writes `text` as a segment at the current position and fills in the size,
+* length and checksum of `entry`. Returns the segment size, or -1 on a short
+* write.
+*/
+int appendArchiveEntry(FILE *output, ArchiveEntry *entry, char *text, int length) {
+    CodeList *codeList = textToCharCodes(text, length);
+    int *charDict = codeListToCharDict(codeList);
+    int size = findCountedCompressedSize(codeList, charDict, length, SEEK_GRANULARITY);
+    char *segment = malloc(sizeof(char) * size);
+
+    compressToBuffer(codeList, charDict, text, length, SEEK_GRANULARITY, segment);
+    if(fwrite(segment, sizeof(char), size, output) != (size_t) size) size = -1;
+
+    entry->length = length;
+    entry->compressedSize = size;
+    entry->checksum = checksum(0, text, length);
+
+    free(segment);
+    freeCodeList(codeList);
+    free(charDict);
+    return size;
+}
+
+/*
+* Returns 0, or -1 on a short write.
+*/
+int writeArchiveDirectory(FILE *output, ArchiveDirectory *directory) {
+    int size = ARCHIVE_TRAILER_SIZE;
+    int position = 0;
+
+    for(int i = 0; i < directory->size; i++) size += ARCHIVE_ENTRY_FIXED_SIZE + (int) strlen(directory->entries[i].name);
+
+    char *buffer = malloc(sizeof(char) * size);
+    for(int i = 0; i < directory->size; i++) {
+        ArchiveEntry *entry = directory->entries + i;
+        int nameLength = (int) strlen(entry->name);
+
+        position = compressDictionaryCode(buffer, position, nameLength, 2);
+        memcpy(buffer + position, entry->name, nameLength);
+        position += nameLength;
+        position = compressDictionaryCode(buffer, position, entry->length, 4);
+        position = compressDictionaryCode(buffer, position, entry->compressedSize, 4);
+        position = compressDictionaryCode(buffer, position, entry->offset, 4);
+        position = compressDictionaryCode(buffer, position, (int) entry->checksum, 4);
+    }
+    position = compressDictionaryCode(buffer, position, directory->end, 4);
+    position = compressDictionaryCode(buffer, position, directory->size, 4);
+    compressDictionaryCode(buffer, position, ARCHIVE_MAGIC, 4);
+
+    int written = fwrite(buffer, sizeof(char), size, output) == (size_t) size;
+    free(buffer);
+    return written ? 0 : -1;
+}
+
+/*
+* Reads the directory through the trailer without touching any segment.
+* Returns NULL if the file is not an archive or the directory is corrupt.
+*/
+ArchiveDirectory * readArchiveDirectory(FILE *input) {
+    unsigned char trailer[ARCHIVE_TRAILER_SIZE];
+
+    if(fseek(input, 0, SEEK_END) != 0) return NULL;
+    long fileSize = ftell(input);
+    if(fileSize < ARCHIVE_TRAILER_SIZE || fileSize > 0x7FFFFFFF) return NULL;
+
+    fseek(input, fileSize - ARCHIVE_TRAILER_SIZE, SEEK_SET);
+    if(fread(trailer, sizeof(char), ARCHIVE_TRAILER_SIZE, input) != ARCHIVE_TRAILER_SIZE) return NULL;
+
+    int end = decompressDictionaryCode(trailer, 4);
+    int count = decompressDictionaryCode(trailer + 4, 4);
+    int size = (int) fileSize - ARCHIVE_TRAILER_SIZE - end;
+    if(decompressDictionaryCode(trailer + 8, 4) != ARCHIVE_MAGIC || end < 0 || size < 0 || count < 0) return NULL;
+    if((long) count * ARCHIVE_ENTRY_FIXED_SIZE > size) return NULL;
+
+    unsigned char *buffer = malloc(sizeof(char) * (size > 0 ? size : 1));
+    fseek(input, end, SEEK_SET);
+    if(fread(buffer, sizeof(char), size, input) != (size_t) size) {
+        free(buffer);
+        return NULL;
+    }
+
+    ArchiveDirectory *directory = malloc(sizeof(ArchiveDirectory));
+    directory->entries = calloc(count > 0 ? count : 1, sizeof(ArchiveEntry));
+    directory->size = count;
+    directory->end = end;
+
+    int valid = parseArchiveDirectory(directory, buffer, size, end);
+    free(buffer);
+    if(!valid) {
+        freeArchiveDirectory(directory);
+        return NULL;
+    }
+
+    return directory;
+}
+
+int parseArchiveDirectory(ArchiveDirectory *directory, unsigned char *buffer, int size, int end) {
+    int position = 0;
+
+    for(int i = 0; i < directory->size; i++) {
+        ArchiveEntry *entry = directory->entries + i;
+        if(position + 2 > size) return 0;
+
+        int nameLength = decompressDictionaryCode(buffer + position, 2);
+        position += 2;
+        if(nameLength == 0 || nameLength > ARCHIVE_MAX_NAME || position + nameLength + ARCHIVE_ENTRY_FIXED_SIZE - 2 > size) return 0;
+
+        entry->name = malloc(sizeof(char) * (nameLength + 1));
+        memcpy(entry->name, buffer + position, nameLength);
+        entry->name[nameLength] = '\0';
+        position += nameLength;
+
+        entry->length = decompressDictionaryCode(buffer + position, 4);
+        entry->compressedSize = decompressDictionaryCode(buffer + position + 4, 4);
+        entry->offset = decompressDictionaryCode(buffer + position + 8, 4);
+        entry->checksum = (unsigned int) decompressDictionaryCode(buffer + position + 12, 4);
+        position += 16;
+
+        if(entry->length < 0 || entry->compressedSize < HEADER_SIZE || entry->offset < 0) return 0;
+        if((long) entry->offset + entry->compressedSize > end || !validEntryName(entry->name)) return 0;
+    }
+
+    return position == size;
+}
+
+void freeArchiveDirectory(ArchiveDirectory *directory) {
+    for(int i = 0; i < directory->size; i++) free(directory->entries[i].name);
+    free(directory->entries);
+    free(directory);
+}
+
+int findArchiveEntry(ArchiveDirectory *directory, char *name) {
+    for(int i = 0; i < directory->size; i++) {
+        if(strcmp(directory->entries[i].name, name) == 0) return i;
+    }
+
+    return -1;
+}
+
+/*
+* Decodes one entry and checks its length and checksum against the
+* directory. Returns the text, or NULL if the entry is corrupt.
+*/
+char * readArchiveEntry(FILE *input, ArchiveEntry *entry) {
+    unsigned char *segment = calloc(entry->compressedSize + READ_PADDING, sizeof(char));
+    char *text = malloc(sizeof(char) * (entry->length > 0 ? entry->length : 1));
+    int valid = 0;
+
+    fseek(input, entry->offset, SEEK_SET);
+    if(fread(segment, sizeof(char), entry->compressedSize, input) == (size_t) entry->compressedSize
+        && findDecompressedSize(segment) == entry->length
+        && decompressToBuffer(segment, entry->compressedSize, text) == entry->length) {
+        valid = checksum(0, text, entry->length) == entry->checksum;
+    }
+
+    free(segment);
+    if(!valid) {
+        free(text);
+        return NULL;
+    }
+
+    return text;
+}
+
+/*
+* Streams one entry through a fixed buffer without keeping its text. Returns
+* 0 if its length, extent and checksum match the directory, -1 otherwise.
+*/
+int verifyArchiveEntry(FILE *input, ArchiveEntry *entry) {
+    unsigned int crc = 0;
+    long end = 0;
+    int decoded = decodeSegments(input, entry->offset, 1, NULL, &crc, &end);
+
+    if(decoded != entry->length || end != (long) entry->offset + entry->compressedSize || crc != entry->checksum) return -1;
+    return 0;
+}
+
+void listArchive(char *archive) {
+    FILE *input = fopen(archive, "rb");
+    ArchiveDirectory *directory = NULL;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", archive);
+        return;
+    }
+
+    directory = readArchiveDirectory(input);
+    fclose(input);
+    if(directory == NULL) {
+        printf("Corrupt archive file %s\n", archive);
+        return;
+    }
+
+    for(int i = 0; i < directory->size; i++) {
+        ArchiveEntry *entry = directory->entries + i;
+        printf("%10d %10d %08x %s\n", entry->length, entry->compressedSize, entry->checksum, entry->name);
+    }
+    freeArchiveDirectory(directory);
+}
+
+void extractArchiveEntry(char *archive, char *name, char *output) {
+    FILE *input = fopen(archive, "rb");
+    ArchiveDirectory *directory = NULL;
+    int index = -1;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", archive);
+        return;
+    }
+
+    directory = readArchiveDirectory(input);
+    if(directory == NULL) printf("Corrupt archive file %s\n", archive);
+    else if((index = findArchiveEntry(directory, name)) == -1) printf("No entry %s in archive %s\n", name, archive);
+
+    if(index != -1) {
+        char *text = readArchiveEntry(input, directory->entries + index);
+        if(text == NULL) printf("Corrupt archive entry %s\n", name);
+        else writeEntryFile(output, text, directory->entries[index].length);
+        free(text);
+    }
+
+    if(directory != NULL) freeArchiveDirectory(directory);
+    fclose(input);
+}
+
+/*
+* Extracts every entry below `directory`. Workers claim entries one at a time
+* and each entry is read through its own FILE, so no seek position is shared.
+* Returns the number of entries that failed.
+*/
+int extractArchive(char *archive, char *directory, int workerCount) {
+    FILE *input = fopen(archive, "rb");
+    ExtractJob job;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", archive);
+        return -1;
+    }
+
+    job.entries = readArchiveDirectory(input);
+    fclose(input);
+    if(job.entries == NULL) {
+        printf("Corrupt archive file %s\n", archive);
+        return -1;
+    }
+
+    job.archive = archive;
+    job.directory = directory;
+    job.failed = calloc(job.entries->size > 0 ? job.entries->size : 1, sizeof(int));
+    runWorkers(&job, job.entries->size, workerCount > 0 ? workerCount : 1, extractEntry);
+
+    int failures = 0;
+    for(int i = 0; i < job.entries->size; i++) failures += job.failed[i];
+
+    free(job.failed);
+    freeArchiveDirectory(job.entries);
+    return failures;
+}
+
+void extractEntry(void *argument, int index) {
+    ExtractJob *job = argument;
+    ArchiveEntry *entry = job->entries->entries + index;
+    FILE *input = fopen(job->archive, "rb");
+    char *text = input == NULL ? NULL : readArchiveEntry(input, entry);
+    char *path = joinPath(job->directory, entry->name);
+
+    if(text == NULL) printf("Corrupt archive entry %s\n", entry->name);
+    job->failed[index] = text == NULL || makeParentDirectories(path) == -1 || writeEntryFile(path, text, entry->length) == -1;
+
+    if(input != NULL) fclose(input);
+    free(path);
+    free(text);
+}
+
+int isArchiveFile(char *filename) {
+    FILE *input = fopen(filename, "rb");
+    ArchiveDirectory *directory = NULL;
+
+    if(input == NULL) return 0;
+    directory = readArchiveDirectory(input);
+    fclose(input);
+    if(directory == NULL) return 0;
+
+    freeArchiveDirectory(directory);
+    return 1;
+}
+
+/*
+* Entries are stored relative: leading "/" and "./" are dropped.
+*/
+char * archiveEntryName(char *path) {
+    while(1) {
+        if(path[0] == '/') path += 1;
+        else if(path[0] == '.' && path[1] == '/') path += 2;
+        else return path;
+    }
+}
+
+int validEntryName(char *name) {
+    int length = (int) strlen(name);
+    if(length == 0 || length > ARCHIVE_MAX_NAME || name[0] == '/') return 0;
+
+    for(int i = 0; i < length; i++) {
+        int componentStart = i == 0 || name[i - 1] == '/';
+        if(componentStart && name[i] == '.' && name[i + 1] == '.' && (name[i + 2] == '/' || name[i + 2] == '\0')) return 0;
+    }
+
+    return 1;
+}
+
+char * joinPath(char *directory, char *name) {
+    int directoryLength = (int) strlen(directory);
+    char *path = malloc(sizeof(char) * (directoryLength + strlen(name) + 2));
+
+    sprintf(path, "%s/%s", directory, name);
+    return path;
+}
+
+int makeParentDirectories(char *path) {
+    for(char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        int result = mkdir(path, 0755);
+        *slash = '/';
+
+        if(result == -1 && errno != EEXIST) {
+            printf("Error while creating directory for %s\n", path);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int writeEntryFile(char *filename, char *text, int length) {
+    FILE *output = fopen(filename, "wb");
+
+    if(output == NULL) {
+        printf("Error while opening file %s\n", filename);
+        return -1;
+    }
+
+    int written = (int) fwrite(text, sizeof(char), length, output);
+    fclose(output);
+    return written == length ? 0 : -1;
+}
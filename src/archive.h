@@ -0,0 +1,53 @@
+/*
+* Archive layout, little endian:
+*
+*   entries:   one compressed segment per input, back to back
+*   directory: per entry name length (2 bytes), name, original length,
+*              compressed size, segment offset, CRC-32C (4 bytes each)
+*   trailer:   directory offset (4 bytes), entry count (4 bytes), ARCHIVE_MAGIC
+*
+* Names are relative paths without ".." components.
+*/
+#define ARCHIVE_MAGIC 0x56524148
+#define ARCHIVE_TRAILER_SIZE 12
+#define ARCHIVE_ENTRY_FIXED_SIZE 18
+#define ARCHIVE_MAX_NAME 4096
+#define ARCHIVE_WORKERS 4
+
+/*
+* Struct definitions
+*/
+typedef struct ArchiveEntry {
+    char *name;
+    int length;
+    int compressedSize;
+    int offset;
+    unsigned int checksum;
+} ArchiveEntry;
+
+typedef struct ArchiveDirectory {
+    ArchiveEntry *entries;
+    int size;
+    int end;
+} ArchiveDirectory;
+
+typedef struct ExtractJob {
+    char *archive;
+    char *directory;
+    ArchiveDirectory *entries;
+    int *failed;
+} ExtractJob;
+
+/*
+* Function declarations
+*/
+int createArchive(char *, char **, int);
+ArchiveDirectory * readArchiveDirectory(FILE *);
+void freeArchiveDirectory(ArchiveDirectory *);
+int findArchiveEntry(ArchiveDirectory *, char *);
+char * readArchiveEntry(FILE *, ArchiveEntry *);
+int verifyArchiveEntry(FILE *, ArchiveEntry *);
+void listArchive(char *);
+void extractArchiveEntry(char *, char *, char *);
+int extractArchive(char *, char *, int);
+int isArchiveFile(char *);
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compression.h"
+#include "archive.h"
+
+/*
+* Kernel declarations
+*/
+int compressDictionaryCode(char *, int, int, int);
+int decompressDictionaryCode(unsigned char *, int);
+
+/*
+* Function declarations
+*/
+BlockIndex * readSingleSegment(FILE *, long);
+int hasArchiveTrailer(FILE *, long);
+int validBlockIndex(BlockIndex *);
+
+
+/*
+* Function definitions
+*/
+
+/*
+* An appended file is a run of segments followed by the block index: one
+* (offset, table offset, start, length) entry per segment, 4 bytes each, then
+* the entry count and BLOCK_INDEX_MAGIC. A file without the trailer is read as
+* a single segment. Returns NULL if the file cannot be seeked, is too short or
+* ends in an archive trailer, whose entries are not one stream.
+*/
+BlockIndex * readBlockIndex(FILE *input) {
+    unsigned char trailer[BLOCK_INDEX_TRAILER_SIZE];
+
+    if(fseek(input, 0, SEEK_END) != 0) return NULL;
+    long fileSize = ftell(input);
+    if(fileSize < HEADER_SIZE || hasArchiveTrailer(input, fileSize)) return NULL;
+    if(fileSize < HEADER_SIZE + BLOCK_INDEX_TRAILER_SIZE) return readSingleSegment(input, fileSize);
+
+    fseek(input, fileSize - BLOCK_INDEX_TRAILER_SIZE, SEEK_SET);
+    if(fread(trailer, sizeof(char), BLOCK_INDEX_TRAILER_SIZE, input) != BLOCK_INDEX_TRAILER_SIZE) return NULL;
+
+    int count = decompressDictionaryCode(trailer, 4);
+    int magic = decompressDictionaryCode(trailer + 4, 4);
+    if(magic != BLOCK_INDEX_MAGIC || count <= 0 || (long) count * BLOCK_ENTRY_SIZE + BLOCK_INDEX_TRAILER_SIZE > fileSize) {
+        return readSingleSegment(input, fileSize);
+    }
+
+    BlockIndex *blocks = malloc(sizeof(BlockIndex));
+    unsigned char *entries = malloc(sizeof(char) * count * BLOCK_ENTRY_SIZE);
+    blocks->size = count;
+    blocks->end = (int) (fileSize - BLOCK_INDEX_TRAILER_SIZE - (long) count * BLOCK_ENTRY_SIZE);
+    blocks->entries = malloc(sizeof(BlockEntry) * count);
+
+    fseek(input, blocks->end, SEEK_SET);
+    if(fread(entries, sizeof(char), count * BLOCK_ENTRY_SIZE, input) != (size_t) count * BLOCK_ENTRY_SIZE) blocks->size = 0;
+    for(int i = 0; i < blocks->size; i++) {
+        unsigned char *entry = entries + i * BLOCK_ENTRY_SIZE;
+        blocks->entries[i].offset = decompressDictionaryCode(entry, 4);
+        blocks->entries[i].tableOffset = decompressDictionaryCode(entry + 4, 4);
+        blocks->entries[i].start = decompressDictionaryCode(entry + 8, 4);
+        blocks->entries[i].length = decompressDictionaryCode(entry + 12, 4);
+    }
+    free(entries);
+
+    if(!validBlockIndex(blocks)) {
+        freeBlockIndex(blocks);
+        return readSingleSegment(input, fileSize);
+    }
+    return blocks;
+}
+
+/*
+* Only a plain segment can stand alone. Counts above 256 mark the token and
+* block-sorted formats, which carry no block index and cannot be appended to
+* or extracted from.
+*/
+BlockIndex * readSingleSegment(FILE *input, long fileSize) {
+    unsigned char header[HEADER_SIZE];
+
+    fseek(input, 0, SEEK_SET);
+    if(fread(header, sizeof(char), HEADER_SIZE, input) != HEADER_SIZE) return NULL;
+
+    int symbolCount = decompressDictionaryCode(header, 2);
+    if(symbolCount > 256 && symbolCount != REUSE_TABLE) return NULL;
+
+    BlockIndex *blocks = malloc(sizeof(BlockIndex));
+    blocks->entries = malloc(sizeof(BlockEntry));
+    blocks->entries[0].offset = 0;
+    blocks->entries[0].tableOffset = 0;
+    blocks->entries[0].start = 0;
+    blocks->entries[0].length = findDecompressedSize(header);
+    blocks->size = 1;
+    blocks->end = (int) fileSize;
+    return blocks;
+}
+
+int hasArchiveTrailer(FILE *input, long fileSize) {
+    unsigned char magic[4];
+
+    if(fileSize < ARCHIVE_TRAILER_SIZE) return 0;
+    fseek(input, fileSize - 4, SEEK_SET);
+    return fread(magic, sizeof(char), 4, input) == 4 && decompressDictionaryCode(magic, 4) == ARCHIVE_MAGIC;
+}
+
+int validBlockIndex(BlockIndex *blocks) {
+    if(blocks->size == 0 || blocks->entries[0].offset != 0 || blocks->entries[0].start != 0) return 0;
+
+    for(int i = 0; i < blocks->size; i++) {
+        BlockEntry *entry = blocks->entries + i;
+        int nextOffset = i + 1 < blocks->size ? blocks->entries[i + 1].offset : blocks->end;
+
+        if(entry->offset >= nextOffset || entry->tableOffset > entry->offset || entry->length < 0) return 0;
+        if(i > 0 && entry->start != blocks->entries[i - 1].start + blocks->entries[i - 1].length) return 0;
+    }
+
+    return 1;
+}
+
+/*
+* Writes the block index at blocks->end. The index only ever grows, so it
+* always overwrites the previous one completely. Returns -1 if the write or
+* flush fails.
+*/
+int writeBlockIndex(FILE *output, BlockIndex *blocks) {
+    int size = blocks->size * BLOCK_ENTRY_SIZE + BLOCK_INDEX_TRAILER_SIZE;
+    char *index = malloc(sizeof(char) * size);
+    int position = 0;
+
+    for(int i = 0; i < blocks->size; i++) {
+        position = compressDictionaryCode(index, position, blocks->entries[i].offset, 4);
+        position = compressDictionaryCode(index, position, blocks->entries[i].tableOffset, 4);
+        position = compressDictionaryCode(index, position, blocks->entries[i].start, 4);
+        position = compressDictionaryCode(index, position, blocks->entries[i].length, 4);
+    }
+    position = compressDictionaryCode(index, position, blocks->size, 4);
+    compressDictionaryCode(index, position, BLOCK_INDEX_MAGIC, 4);
+
+    int written = fseek(output, blocks->end, SEEK_SET) == 0 && fwrite(index, sizeof(char), size, output) == (size_t) size;
+    free(index);
+    return written && fflush(output) == 0 ? 0 : -1;
+}
+
+void freeBlockIndex(BlockIndex *blocks) {
+    free(blocks->entries);
+    free(blocks);
+}
+
+int findArchivedLength(BlockIndex *blocks) {
+    BlockEntry *last = blocks->entries + blocks->size - 1;
+    return last->start + last->length;
+}
+
+/*
+* Loads the dictionary of the segment at `offset`. Fails for segments that
+* reuse an earlier table, since block entries always point past those.
+*/
+int readSegmentTable(FILE *input, long offset, int *charDict) {
+    unsigned char header[HEADER_SIZE + MAX_DICTIONARY_SIZE];
+    int length = 0;
+
+    fseek(input, offset, SEEK_SET);
+    int headerSize = (int) fread(header, sizeof(char), sizeof(header), input);
+    if(headerSize < HEADER_SIZE || decompressDictionaryCode(header, 2) == REUSE_TABLE) return -1;
+
+    return decompressDictionaryHeader(header, headerSize, charDict, &length) == -1 ? -1 : 0;
+}
+
+/*
+* Writes `text` as a new segment after the last one and rewrites the block
+* index behind it. A NULL codeList reuses the table of the last segment.
+* The segment overwrites the old index, so it is flushed before the new index
+* is written; if either fails the file no longer matches its index and is
+* reported as corrupt when read. Returns the size of the new segment, or -1.
+*/
+int appendSegment(FILE *archive, BlockIndex *blocks, CodeList *codeList, int *charDict, char *text, int length, int granularity) {
+    int size = findCompressedSize(codeList, charDict, text, length, granularity);
+    char *segment = malloc(sizeof(char) * size);
+    BlockEntry last = blocks->entries[blocks->size - 1];
+
+    compressToBuffer(codeList, charDict, text, length, granularity, segment);
+    int written = fseek(archive, blocks->end, SEEK_SET) == 0 && fwrite(segment, sizeof(char), size, archive) == (size_t) size;
+    free(segment);
+    if(!written || fflush(archive) != 0) return -1;
+
+    blocks->entries = realloc(blocks->entries, sizeof(BlockEntry) * (blocks->size + 1));
+    blocks->entries[blocks->size].offset = blocks->end;
+    blocks->entries[blocks->size].tableOffset = codeList == NULL ? last.tableOffset : blocks->end;
+    blocks->entries[blocks->size].start = last.start + last.length;
+    blocks->entries[blocks->size].length = length;
+    blocks->size += 1;
+    blocks->end += size;
+
+    return writeBlockIndex(archive, blocks) == -1 ? -1 : size;
+}
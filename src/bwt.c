@@ -0,0 +1,512 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compression.h"
+#include "bwt.h"
+
+/*
+* Kernel declarations
+*/
+CodeList * textToCharCodes(char *, int);
+int * codeListToCharDict(CodeList *);
+int compressDictionaryCode(char *, int, int, int);
+int decompressDictionaryCode(unsigned char *, int);
+
+/*
+* Function declarations
+*/
+int readBlock(FILE *, long, long *, BwtBlock *);
+void encodeBlockWork(void *, int);
+void decodeBlockWork(void *, int);
+void encodeBlock(BwtBlock *);
+void decodeBlock(BwtBlock *);
+void buildSuffixArray(int *, int *, int, int);
+void findBuckets(int *, int, int *, int, int);
+void induceLTypes(unsigned char *, int *, int *, int *, int, int);
+void induceSTypes(unsigned char *, int *, int *, int *, int, int);
+int burrowsWheeler(char *, int, unsigned char *);
+int inverseBurrowsWheeler(unsigned char *, int, int, char *);
+void moveToFront(unsigned char *, int);
+void inverseMoveToFront(unsigned char *, int);
+int encodeZeroRuns(unsigned char *, int, unsigned char *);
+int decodeZeroRuns(unsigned char *, int, unsigned char *, int);
+
+
+/*
+* Function definitions
+*/
+void compressBlocksAndWriteToFile(char *text, int length, char *filename) {
+    char *compressedText = NULL;
+    int size = compressBlocksToBuffer(text, length, &compressedText);
+
+    writeToFile(filename, compressedText, size);
+    free(compressedText);
+}
+
+/*
+* Cuts `text` into BWT_BLOCK_SIZE blocks, transforms and Huffman codes them
+* on the encode workers, then lays them out in order. Allocates
+* *compressedText and returns its size.
+*/
+int compressBlocksToBuffer(char *text, int length, char **compressedText) {
+    int count = (length + BWT_BLOCK_SIZE - 1) / BWT_BLOCK_SIZE;
+    BwtBlock *blocks = calloc(count > 0 ? count : 1, sizeof(BwtBlock));
+    int size = BWT_HEADER_SIZE;
+
+    for(int i = 0; i < count; i++) {
+        blocks[i].text = text + (long) i * BWT_BLOCK_SIZE;
+        blocks[i].length = i + 1 < count ? BWT_BLOCK_SIZE : length - i * BWT_BLOCK_SIZE;
+    }
+    runWorkers(blocks, count, findEncodeWorkers(), encodeBlockWork);
+    for(int i = 0; i < count; i++) size += BWT_BLOCK_HEADER_SIZE + blocks[i].segmentSize;
+
+    *compressedText = malloc(sizeof(char) * size);
+    int index = compressDictionaryCode(*compressedText, 0, BWT_TABLE, 2);
+    index = compressDictionaryCode(*compressedText, index, length, 4);
+    index = compressDictionaryCode(*compressedText, index, (int) checksum(0, text, length), 4);
+    index = compressDictionaryCode(*compressedText, index, BWT_BLOCK_SIZE, 4);
+    index = compressDictionaryCode(*compressedText, index, count, 4);
+
+    for(int i = 0; i < count; i++) {
+        index = compressDictionaryCode(*compressedText, index, blocks[i].primary, 4);
+        index = compressDictionaryCode(*compressedText, index, blocks[i].transformedLength, 4);
+        index = compressDictionaryCode(*compressedText, index, blocks[i].segmentSize, 4);
+        memcpy(*compressedText + index, blocks[i].segment, blocks[i].segmentSize);
+        index += blocks[i].segmentSize;
+        free(blocks[i].segment);
+    }
+
+    free(blocks);
+    return size;
+}
+
+void decompressBlocksAndWriteToFile(char *compressedFilename, char *uncompressedFilename) {
+    FILE *input = fopen(compressedFilename, "rb");
+    FILE *output = NULL;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", compressedFilename);
+        return;
+    }
+
+    output = fopen(uncompressedFilename, "wb");
+    if(output == NULL) {
+        printf("Error while opening file %s\n", uncompressedFilename);
+        fclose(input);
+        return;
+    }
+
+    int decoded = decompressBlockStream(input, output, NULL);
+    int written = !ferror(output);
+    if(fclose(output) != 0) written = 0;
+    fclose(input);
+
+    if(!written) printf("Failed to write %s\n", uncompressedFilename);
+    else if(decoded == -1) printf("Corrupt compressed file %s\n", compressedFilename);
+    if(!written || decoded == -1) remove(uncompressedFilename);
+}
+
+/*
+* Reads one batch of blocks per encode worker, decodes the batch in parallel
+* and flushes it in order, so memory stays at one block and its segment per
+* worker. Output goes to `output` and/or the checksum `crc`, either of which
+* may be NULL. Fails unless the last block ends at the end of the file and
+* the text matches the checksum in the header.
+* Returns the decoded length, or -1 if the stream is corrupt.
+*/
+int decompressBlockStream(FILE *input, FILE *output, unsigned int *crc) {
+    unsigned char header[BWT_HEADER_SIZE];
+
+    if(fseek(input, 0, SEEK_END) != 0) return -1;
+    long fileSize = ftell(input);
+    fseek(input, 0, SEEK_SET);
+    if(fread(header, sizeof(char), BWT_HEADER_SIZE, input) != BWT_HEADER_SIZE || decompressDictionaryCode(header, 2) != BWT_TABLE) return -1;
+
+    int length = findDecompressedSize(header);
+    int blockSize = decompressDictionaryCode(header + 10, 4);
+    int count = decompressDictionaryCode(header + 14, 4);
+    if(length < 0 || blockSize <= 0 || blockSize > BWT_BLOCK_SIZE || count != (int) (((long) length + blockSize - 1) / blockSize)) return -1;
+    if((long) count * (BWT_BLOCK_HEADER_SIZE + HEADER_SIZE) > fileSize - BWT_HEADER_SIZE) return -1;
+
+    int batchSize = findEncodeWorkers();
+    BwtBlock *blocks = calloc(batchSize, sizeof(BwtBlock));
+    char *text = malloc(sizeof(char) * batchSize * blockSize);
+    long position = BWT_HEADER_SIZE;
+    unsigned int textCrc = 0;
+    int valid = 1;
+
+    for(int first = 0; first < count && valid; first += batchSize) {
+        int batch = count - first < batchSize ? count - first : batchSize;
+
+        for(int i = 0; i < batch && valid; i++) {
+            blocks[i].text = text + (long) i * blockSize;
+            blocks[i].length = first + i + 1 < count ? blockSize : length - (first + i) * blockSize;
+            valid = readBlock(input, fileSize, &position, blocks + i) == 0;
+        }
+        if(valid) runWorkers(blocks, batch, batch, decodeBlockWork);
+
+        for(int i = 0; i < batch && valid; i++) {
+            valid = !blocks[i].failed;
+            if(valid && output != NULL) valid = fwrite(blocks[i].text, sizeof(char), blocks[i].length, output) == (size_t) blocks[i].length;
+            if(valid) textCrc = checksum(textCrc, blocks[i].text, blocks[i].length);
+        }
+        for(int i = 0; i < batch; i++) {
+            free(blocks[i].segment);
+            blocks[i].segment = NULL;
+        }
+    }
+
+    free(text);
+    free(blocks);
+    if(!valid || position != fileSize || textCrc != findStoredChecksum(header)) return -1;
+    if(crc != NULL) *crc = textCrc;
+    return length;
+}
+
+/*
+* Reads the block header and segment at *position, which must lie inside the
+* file. The segment is padded like readFromFile pads whole files.
+*/
+int readBlock(FILE *input, long fileSize, long *position, BwtBlock *block) {
+    unsigned char header[BWT_BLOCK_HEADER_SIZE];
+
+    if(*position + BWT_BLOCK_HEADER_SIZE > fileSize || fread(header, sizeof(char), BWT_BLOCK_HEADER_SIZE, input) != BWT_BLOCK_HEADER_SIZE) return -1;
+    block->primary = decompressDictionaryCode(header, 4);
+    block->transformedLength = decompressDictionaryCode(header + 4, 4);
+    block->segmentSize = decompressDictionaryCode(header + 8, 4);
+    *position += BWT_BLOCK_HEADER_SIZE;
+    if(block->segmentSize < HEADER_SIZE || block->segmentSize > fileSize - *position) return -1;
+
+    block->segment = calloc(block->segmentSize + READ_PADDING, sizeof(char));
+    if(fread(block->segment, sizeof(char), block->segmentSize, input) != (size_t) block->segmentSize) return -1;
+    *position += block->segmentSize;
+    return 0;
+}
+
+void encodeBlockWork(void *blocks, int index) {
+    encodeBlock((BwtBlock *) blocks + index);
+}
+
+void decodeBlockWork(void *blocks, int index) {
+    decodeBlock((BwtBlock *) blocks + index);
+}
+
+void encodeBlock(BwtBlock *block) {
+    unsigned char *transformed = malloc(sizeof(char) * (block->length + 1));
+    unsigned char *runs = malloc(sizeof(char) * (2 * block->length + 1));
+
+    block->primary = burrowsWheeler(block->text, block->length, transformed);
+    moveToFront(transformed, block->length);
+    block->transformedLength = encodeZeroRuns(transformed, block->length, runs);
+
+    CodeList *codeList = textToCharCodes((char *) runs, block->transformedLength);
+    int *charDict = codeListToCharDict(codeList);
+    block->segmentSize = findCountedCompressedSize(codeList, charDict, block->transformedLength, 0);
+    block->segment = malloc(sizeof(char) * block->segmentSize);
+    compressToBuffer(codeList, charDict, (char *) runs, block->transformedLength, 0, (char *) block->segment);
+
+    freeCodeList(codeList);
+    free(charDict);
+    free(runs);
+    free(transformed);
+}
+
+void decodeBlock(BwtBlock *block) {
+    int transformedLength = block->transformedLength;
+    unsigned char *runs = NULL;
+    unsigned char *transformed = NULL;
+
+    block->failed = 1;
+    if(transformedLength < 0 || transformedLength > 2 * block->length || findDecompressedSize(block->segment) != transformedLength) return;
+
+    runs = malloc(sizeof(char) * (transformedLength + 1));
+    transformed = malloc(sizeof(char) * (block->length + 1));
+    if(decompressToBuffer(block->segment, block->segmentSize, (char *) runs) == transformedLength
+        && decodeZeroRuns(runs, transformedLength, transformed, block->length) == block->length) {
+        inverseMoveToFront(transformed, block->length);
+        block->failed = inverseBurrowsWheeler(transformed, block->length, block->primary, block->text) == -1;
+    }
+
+    free(runs);
+    free(transformed);
+}
+
+/*
+* BWT of `text` with a virtual end marker that sorts first. The row holding
+* the marker is left out of `transformed`; its index is returned.
+*/
+int burrowsWheeler(char *text, int length, unsigned char *transformed) {
+    int *symbols = malloc(sizeof(int) * (length + 1));
+    int *suffixes = malloc(sizeof(int) * (length + 1));
+    int primary = 0;
+    int position = 0;
+
+    for(int i = 0; i < length; i++) symbols[i] = (unsigned char) text[i] + 1;
+    symbols[length] = 0;
+    buildSuffixArray(symbols, suffixes, length + 1, 257);
+
+    for(int i = 0; i <= length; i++) {
+        if(suffixes[i] == 0) primary = i;
+        else transformed[position++] = (unsigned char) text[suffixes[i] - 1];
+    }
+
+    free(symbols);
+    free(suffixes);
+    return primary;
+}
+
+/*
+* Rebuilds the text back to front through the last-to-first mapping. Returns
+* -1 if the primary index is inconsistent with the data.
+*/
+int inverseBurrowsWheeler(unsigned char *transformed, int length, int primary, char *text) {
+    int less[256] = {0};
+    int seen[256] = {0};
+    int *next = NULL;
+    int row = 0;
+
+    if(length == 0) return primary == 0 ? 0 : -1;
+    if(primary < 1 || primary > length) return -1;
+
+    for(int i = 0; i < length; i++) seen[transformed[i]] += 1;
+    for(int c = 1; c < 256; c++) less[c] = less[c - 1] + seen[c - 1];
+    memset(seen, 0, sizeof(seen));
+
+    next = malloc(sizeof(int) * (length + 1));
+    for(int i = 0; i <= length; i++) {
+        if(i == primary) continue;
+        int c = transformed[i < primary ? i : i - 1];
+        next[i] = 1 + less[c] + seen[c]++;
+    }
+
+    for(int k = length - 1; k >= 0; k--) {
+        if(row == primary) {
+            free(next);
+            return -1;
+        }
+        text[k] = (char) transformed[row < primary ? row : row - 1];
+        row = next[row];
+    }
+
+    free(next);
+    return row == primary ? length : -1;
+}
+
+/*
+* SA-IS suffix array of `symbols`, whose last symbol must be a unique 0.
+* Runs in linear time; `alphabet` bounds the symbol values.
+*/
+void buildSuffixArray(int *symbols, int *suffixes, int length, int alphabet) {
+    unsigned char *types = malloc(sizeof(char) * length);
+    int *buckets = malloc(sizeof(int) * alphabet);
+    int lmsCount = 0;
+    int names = 0;
+    int previous = -1;
+
+    if(length == 1) {
+        suffixes[0] = 0;
+        free(types);
+        free(buckets);
+        return;
+    }
+
+    types[length - 1] = 1;
+    types[length - 2] = 0;
+    for(int i = length - 3; i >= 0; i--) {
+        types[i] = symbols[i] < symbols[i + 1] || (symbols[i] == symbols[i + 1] && types[i + 1]);
+    }
+
+#define IS_LMS(i) ((i) > 0 && types[i] && !types[(i) - 1])
+
+    findBuckets(symbols, length, buckets, alphabet, 1);
+    for(int i = 0; i < length; i++) suffixes[i] = -1;
+    for(int i = 1; i < length; i++) {
+        if(IS_LMS(i)) suffixes[--buckets[symbols[i]]] = i;
+    }
+    induceLTypes(types, suffixes, symbols, buckets, length, alphabet);
+    induceSTypes(types, suffixes, symbols, buckets, length, alphabet);
+
+    for(int i = 0; i < length; i++) {
+        if(IS_LMS(suffixes[i])) suffixes[lmsCount++] = suffixes[i];
+    }
+    for(int i = lmsCount; i < length; i++) suffixes[i] = -1;
+
+    for(int i = 0; i < lmsCount; i++) {
+        int position = suffixes[i];
+        int differs = 0;
+
+        for(int d = 0; d < length; d++) {
+            if(previous == -1 || symbols[position + d] != symbols[previous + d] || types[position + d] != types[previous + d]) {
+                differs = 1;
+                break;
+            }
+            if(d > 0 && (IS_LMS(position + d) || IS_LMS(previous + d))) break;
+        }
+        if(differs) {
+            names += 1;
+            previous = position;
+        }
+        suffixes[lmsCount + position / 2] = names - 1;
+    }
+    for(int i = length - 1, j = length - 1; i >= lmsCount; i--) {
+        if(suffixes[i] >= 0) suffixes[j--] = suffixes[i];
+    }
+
+    int *reduced = suffixes + length - lmsCount;
+    if(names < lmsCount) buildSuffixArray(reduced, suffixes, lmsCount, names);
+    else for(int i = 0; i < lmsCount; i++) suffixes[reduced[i]] = i;
+
+    findBuckets(symbols, length, buckets, alphabet, 1);
+    for(int i = 1, j = 0; i < length; i++) {
+        if(IS_LMS(i)) reduced[j++] = i;
+    }
+    for(int i = 0; i < lmsCount; i++) suffixes[i] = reduced[suffixes[i]];
+    for(int i = lmsCount; i < length; i++) suffixes[i] = -1;
+    for(int i = lmsCount - 1; i >= 0; i--) {
+        int j = suffixes[i];
+        suffixes[i] = -1;
+        suffixes[--buckets[symbols[j]]] = j;
+    }
+    induceLTypes(types, suffixes, symbols, buckets, length, alphabet);
+    induceSTypes(types, suffixes, symbols, buckets, length, alphabet);
+
+#undef IS_LMS
+
+    free(buckets);
+    free(types);
+}
+
+void findBuckets(int *symbols, int length, int *buckets, int alphabet, int end) {
+    int sum = 0;
+
+    memset(buckets, 0, sizeof(int) * alphabet);
+    for(int i = 0; i < length; i++) buckets[symbols[i]] += 1;
+    for(int i = 0; i < alphabet; i++) {
+        sum += buckets[i];
+        buckets[i] = end ? sum : sum - buckets[i];
+    }
+}
+
+void induceLTypes(unsigned char *types, int *suffixes, int *symbols, int *buckets, int length, int alphabet) {
+    findBuckets(symbols, length, buckets, alphabet, 0);
+    for(int i = 0; i < length; i++) {
+        int j = suffixes[i] - 1;
+        if(j >= 0 && !types[j]) suffixes[buckets[symbols[j]]++] = j;
+    }
+}
+
+void induceSTypes(unsigned char *types, int *suffixes, int *symbols, int *buckets, int length, int alphabet) {
+    findBuckets(symbols, length, buckets, alphabet, 1);
+    for(int i = length - 1; i >= 0; i--) {
+        int j = suffixes[i] - 1;
+        if(j >= 0 && types[j]) suffixes[--buckets[symbols[j]]] = j;
+    }
+}
+
+void moveToFront(unsigned char *bytes, int length) {
+    unsigned char order[256];
+    for(int i = 0; i < 256; i++) order[i] = (unsigned char) i;
+
+    for(int i = 0; i < length; i++) {
+        unsigned char c = bytes[i];
+        int rank = 0;
+        while(order[rank] != c) rank += 1;
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        bytes[i] = (unsigned char) rank;
+    }
+}
+
+void inverseMoveToFront(unsigned char *bytes, int length) {
+    unsigned char order[256];
+    for(int i = 0; i < 256; i++) order[i] = (unsigned char) i;
+
+    for(int i = 0; i < length; i++) {
+        int rank = bytes[i];
+        unsigned char c = order[rank];
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        bytes[i] = c;
+    }
+}
+
+int encodeZeroRuns(unsigned char *ranks, int length, unsigned char *runs) {
+    int position = 0;
+
+    for(int i = 0; i < length;) {
+        if(ranks[i] == 0) {
+            int run = 0;
+            while(i < length && ranks[i] == 0) {
+                run += 1;
+                i += 1;
+            }
+            while(run > 0) {
+                if(run & 1) {
+                    runs[position++] = BWT_RUN_A;
+                    run = (run - 1) / 2;
+                } else {
+                    runs[position++] = BWT_RUN_B;
+                    run = (run - 2) / 2;
+                }
+            }
+            continue;
+        }
+
+        if(ranks[i] < BWT_ESCAPE - 1) {
+            runs[position++] = (unsigned char) (ranks[i] + 1);
+        } else {
+            runs[position++] = BWT_ESCAPE;
+            runs[position++] = (unsigned char) (ranks[i] - (BWT_ESCAPE - 1));
+        }
+        i += 1;
+    }
+
+    return position;
+}
+
+/*
+* Returns the number of ranks written, or -1 if they would exceed `length`.
+*/
+int decodeZeroRuns(unsigned char *runs, int runsLength, unsigned char *ranks, int length) {
+    int position = 0;
+
+    for(int i = 0; i < runsLength;) {
+        if(runs[i] == BWT_RUN_A || runs[i] == BWT_RUN_B) {
+            long run = 0;
+            long weight = 1;
+            while(i < runsLength && (runs[i] == BWT_RUN_A || runs[i] == BWT_RUN_B)) {
+                run += runs[i] == BWT_RUN_A ? weight : 2 * weight;
+                weight *= 2;
+                i += 1;
+                if(run > length - position) return -1;
+            }
+            memset(ranks + position, 0, run);
+            position += (int) run;
+            continue;
+        }
+
+        int rank = runs[i] - 1;
+        if(runs[i] == BWT_ESCAPE) {
+            if(i + 1 >= runsLength || runs[i + 1] > 1) return -1;
+            rank = BWT_ESCAPE - 1 + runs[i + 1];
+            i += 1;
+        }
+        if(position >= length) return -1;
+        ranks[position++] = (unsigned char) rank;
+        i += 1;
+    }
+
+    return position;
+}
+
+int isBlockSortedFile(char *filename) {
+    FILE *input = fopen(filename, "rb");
+    unsigned char header[2];
+    int isBlockSorted = 0;
+
+    if(input == NULL) return 0;
+    if(fread(header, sizeof(char), 2, input) == 2) isBlockSorted = decompressDictionaryCode(header, 2) == BWT_TABLE;
+    fclose(input);
+    return isBlockSorted;
+}
@@ -0,0 +1,41 @@
+/*
+* Block-sorted files use the segment header with BWT_TABLE in the symbol
+* count, then the block size and block count (4 bytes each). The header
+* checksum covers the whole original text. Every block
+* follows as primary index, transformed length and segment size (4 bytes
+* each) and one ordinary segment holding the transformed bytes.
+*
+* A block is transformed by BWT, move-to-front, then zero-run coding: runs of
+* zeros become bijective base-2 digits BWT_RUN_A/BWT_RUN_B, other ranks are
+* shifted up by one and the two ranks that no longer fit in a byte are
+* written as BWT_ESCAPE followed by rank - 254.
+*/
+#define BWT_TABLE 0xFFFD
+#define BWT_HEADER_SIZE 18
+#define BWT_BLOCK_HEADER_SIZE 12
+#define BWT_BLOCK_SIZE 900000
+#define BWT_RUN_A 0
+#define BWT_RUN_B 1
+#define BWT_ESCAPE 255
+
+/*
+* Struct definitions
+*/
+typedef struct BwtBlock {
+    char *text;
+    int length;
+    unsigned char *segment;
+    int segmentSize;
+    int primary;
+    int transformedLength;
+    int failed;
+} BwtBlock;
+
+/*
+* Function declarations
+*/
+void compressBlocksAndWriteToFile(char *, int, char *);
+int compressBlocksToBuffer(char *, int, char **);
+void decompressBlocksAndWriteToFile(char *, char *);
+int decompressBlockStream(FILE *, FILE *, unsigned int *);
+int isBlockSortedFile(char *);
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <pthread.h>
+
+#include "compression.h"
+
+/*
+* Function declarations
+*/
+unsigned int checksumScalar(unsigned int, char *, int);
+void buildChecksumTable(void);
+
+static unsigned int checksumTable[256];
+static pthread_once_t checksumTableOnce = PTHREAD_ONCE_INIT;
+
+
+/*
+* Function definitions
+*/
+
+/*
+* CRC-32C of `length` bytes, continuing from `crc`. Start with 0; the result
+* of one call can be passed as `crc` to the next to checksum a stream.
+*/
+unsigned int checksum(unsigned int crc, char *text, int length) {
+    return cpuKernels()->checksum(crc, text, length);
+}
+
+unsigned int checksumScalar(unsigned int crc, char *text, int length) {
+    pthread_once(&checksumTableOnce, buildChecksumTable);
+
+    crc = ~crc;
+    for(int i = 0; i < length; i++) {
+        crc = checksumTable[(crc ^ (unsigned char) text[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+void buildChecksumTable(void) {
+    for(unsigned int i = 0; i < 256; i++) {
+        unsigned int crc = i;
+        for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CHECKSUM_POLYNOMIAL & (0 - (crc & 1)));
+        checksumTable[i] = crc;
+    }
+}
@@ -1,3 +1,4 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,77 +8,224 @@
 /*
 * Function declarations
 */
-int findCompressedSize(CodeList *codeList, int *charDict, char *text);
+long findFileLength(FILE *);
+char * readStream(FILE *, int *);
 int findCompressedDictionarySize(CodeList *codeList, int *charDict);
-int findCompressedTextSize(int *charDict, char *text);
-int compressDictionary(CodeList *, int *, char *, int);
+int findCompressedTextSize(int *charDict, char *text, int length);
+int findSeekIndexSize(int length, int granularity);
+int compressDictionary(CodeList *, int *, char *, int, int, unsigned int);
 int compressDictionaryCode(char *, int, int, int);
-int compressText(int *, char *, char *, int);
-int compressTextCode(char *, int, int, int);
+int compressSeekIndex(long *, int, int, char *, int);
+int compressText(int *, char *, int, char *, int);
+int compressTextScalar(int *, char *, int, char *, int);
 int decompressDictionary(unsigned char *, int, int *, int);
 int decompressDictionaryCode(unsigned char *, int);
-char * decompressText(unsigned char *, int, int *);
-char findKeyFromCode(int *, int);
+int decompressSeekIndex(unsigned char *, int, int, int *, int *);
+long findSeekOffset(unsigned char *);
+int decompressSegment(StreamWindow *, long *, int *, char *, FILE *, unsigned int *);
+void refillWindow(StreamWindow *, long *);
+int extractSegment(FILE *, long, long, int *, int, int, char *);
+int decodeRange(int *, unsigned char *, int, long, int, int, char *);
+int decompressText(unsigned char *, int, int, int *, char *, int);
+int decodeTextWidth8(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth10(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth12(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextMultiSymbol(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeLongCode(DecodeTable *, unsigned char *, int, long *);
+DecodeTable * createDecodeTable(int *, int);
+int findKeyFromCode(int *, int);
 char appendBitsToByte(char *, int, int);
+int numberBitsScalar(int);
 
 
 /*
 * Function definitions
 */
-char * readFromFile(char *filename) {
+/*
+* Returns the file with READ_PADDING zero bytes after it, or NULL if it cannot
+* be read or is longer than INT_MAX - READ_PADDING bytes.
+*/
+char * readFromFile(char *filename, int *size) {
     FILE *fp = fopen(filename, "rb");
-    int currentLength = 0;
-    int maxLength = 100;
-    char *fullText = malloc(sizeof(char) * maxLength);
-    int currentValue = 0;
+    char *fullText = NULL;
+    long length = 0;
 
     if(fp == NULL) {
         printf("Error while opening file %s\n", filename);
+        return NULL;
     }
 
-    while((currentValue = fgetc(fp)) != EOF) {
-        *(fullText + currentLength) = (char) currentValue;
-        currentLength += 1;
-        if(currentLength == maxLength) {
-            maxLength *= 2;
-            fullText = realloc(fullText, sizeof(char) * maxLength);
-        }
+    length = findFileLength(fp);
+    if(length == -1) {
+        fullText = readStream(fp, size);
+    } else if(length <= INT_MAX - READ_PADDING) {
+        fullText = malloc(sizeof(char) * (length + READ_PADDING));
+        *size = (int) fread(fullText, sizeof(char), length, fp);
+        memset(fullText + *size, 0, sizeof(char) * READ_PADDING);
     }
-
-    *(fullText + currentLength) = '\0';
-    fullText = realloc(fullText, sizeof(char)*(currentLength + 1));
     fclose(fp);
 
+    if(fullText == NULL) printf("Error while reading file %s\n", filename);
     return fullText;
 }
 
+/*
+* Reads the file from `offset` to its end. Returns NULL if the file is
+* missing, shorter than `offset` or too long for readFromFile.
+*/
+char * readTailFromFile(char *filename, int offset, int *size) {
+    FILE *fp = fopen(filename, "rb");
+    char *tail = NULL;
+    long length = 0;
+
+    if(fp == NULL) {
+        printf("Error while opening file %s\n", filename);
+        return NULL;
+    }
+
+    length = findFileLength(fp);
+    if(length == -1) {
+        tail = readStream(fp, size);
+        if(tail != NULL && *size >= offset) {
+            *size -= offset;
+            memmove(tail, tail + offset, *size);
+            memset(tail + *size, 0, sizeof(char) * READ_PADDING);
+        } else {
+            free(tail);
+            tail = NULL;
+        }
+    } else if(length >= offset && length - offset <= INT_MAX - READ_PADDING && fseek(fp, offset, SEEK_SET) == 0) {
+        tail = malloc(sizeof(char) * (length - offset + READ_PADDING));
+        *size = (int) fread(tail, sizeof(char), length - offset, fp);
+        memset(tail + *size, 0, sizeof(char) * READ_PADDING);
+    }
+    fclose(fp);
+
+    return tail;
+}
+
+/*
+* Length of a seekable file, rewound to its start. -1 for pipes and other
+* streams that cannot seek.
+*/
+long findFileLength(FILE *fp) {
+    long length = -1;
+
+    if(fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) return -1;
+    return length;
+}
+
+/*
+* Reads to end of file into a buffer that doubles as it fills, for inputs that
+* cannot report their length. Returns NULL on a read error or past
+* INT_MAX - READ_PADDING bytes.
+*/
+char * readStream(FILE *fp, int *size) {
+    int capacity = STREAM_BUFFER_SIZE;
+    char *text = malloc(sizeof(char) * (capacity + READ_PADDING));
+    size_t count = 0;
+
+    *size = 0;
+    while(text != NULL && (count = fread(text + *size, sizeof(char), capacity - *size, fp)) > 0) {
+        *size += (int) count;
+        if(*size < capacity) continue;
+
+        if(capacity == INT_MAX - READ_PADDING) {
+            free(text);
+            return NULL;
+        }
+        capacity = capacity > (INT_MAX - READ_PADDING) / 2 ? INT_MAX - READ_PADDING : capacity * 2;
+        char *grown = realloc(text, sizeof(char) * (capacity + READ_PADDING));
+        if(grown == NULL) free(text);
+        text = grown;
+    }
+
+    if(text == NULL || ferror(fp)) {
+        free(text);
+        return NULL;
+    }
+    memset(text + *size, 0, sizeof(char) * READ_PADDING);
+    return text;
+}
+
+/*
+* A short write or failed close removes the partial file.
+*/
 void writeToFile(char *filename, char *text, int size) {
     FILE *file = fopen(filename, "wb");
 
-    int results = fwrite(text, sizeof(char), size, file);
-    if (results == EOF) {
-        printf("Failed to write");
+    if(file == NULL) {
+        printf("Error while opening file %s\n", filename);
+        return;
+    }
+
+    int written = fwrite(text, sizeof(char), size, file) == (size_t) size;
+    if(fclose(file) != 0) written = 0;
+    if(!written) {
+        printf("Failed to write %s\n", filename);
+        remove(filename);
     }
-    fclose(file);
 }
 
-void compressAndWriteToFile(CodeList *codeList, int *charDict, char *text, char *filename) {
-    int size = findCompressedSize(codeList, charDict, text);
-    int index = 0;
-    char compressedText[size];
-    memset(compressedText, 0, sizeof(char) * size);
-    index = compressDictionary(codeList, charDict, compressedText, index);
-    index = compressText(charDict, text, compressedText, index);
+void compressAndWriteToFile(CodeList *codeList, int *charDict, char *text, int length, int granularity, char *filename) {
+    int size = findCountedCompressedSize(codeList, charDict, length, granularity);
+    char *compressedText = malloc(sizeof(char) * size);
+    compressToBuffer(codeList, charDict, text, length, granularity, compressedText);
     writeToFile(filename, compressedText, size);
+    free(compressedText);
 }
 
-int findCompressedSize(CodeList *codeList, int *charDict, char *text) {
-    return findCompressedDictionarySize(codeList, charDict) + findCompressedTextSize(charDict, text);
+/*
+* Writes the header, dictionary, seek index and text into caller provided
+* memory of at least findCompressedSize bytes. Returns the number of bytes
+* written. A granularity of 0 stores an empty seek index. The parallel
+* encoder finds the seek offsets and the checksum while it encodes; the
+* header is written last, once they are known.
+*/
+int compressToBuffer(CodeList *codeList, int *charDict, char *text, int length, int granularity, char *compressedText) {
+    int entries = granularity > 0 ? (length + granularity - 1) / granularity : 0;
+    int dictionarySize = findCompressedDictionarySize(codeList, charDict);
+    int index = dictionarySize + findSeekIndexSize(length, granularity);
+    long *seekBits = malloc(sizeof(long) * (entries > 0 ? entries : 1));
+    int workers = length >= PARALLEL_MIN_LENGTH ? findEncodeWorkers() : 1;
+    unsigned int crc = 0;
+    int size = 0;
+
+    if(workers > 1) {
+        size = compressTextParallel(charDict, text, length, compressedText, index, workers, granularity, seekBits, &crc);
+    } else {
+        int codeBits[256];
+        for(int i = 0; i < 256; i++) codeBits[i] = numberBits(charDict[i]);
+        if(entries > 0) countSeekBits(codeBits, text, 0, length, granularity, seekBits);
+        size = compressText(charDict, text, length, compressedText, index);
+        crc = checksum(0, text, length);
+    }
+
+    memset(compressedText, 0, sizeof(char) * index);
+    compressDictionary(codeList, charDict, compressedText, 0, length, crc);
+    compressSeekIndex(seekBits, entries, granularity, compressedText, dictionarySize);
+    free(seekBits);
+    return size;
+}
+
+int findCompressedSize(CodeList *codeList, int *charDict, char *text, int length, int granularity) {
+    return findCompressedDictionarySize(codeList, charDict) + findSeekIndexSize(length, granularity) + findCompressedTextSize(charDict, text, length);
+}
+
+/*
+* Same as findCompressedSize when codeList was counted from the text itself,
+* from its frequencies instead of a pass over the text.
+*/
+int findCountedCompressedSize(CodeList *codeList, int *charDict, int length, int granularity) {
+    long long bits = 0;
+
+    for(int i = 0; i < codeList->size; i++) bits += (long long) codeList->root[i].freq * numberBits(charDict[codeList->root[i].key]);
+    return findCompressedDictionarySize(codeList, charDict) + findSeekIndexSize(length, granularity) + (int) ((bits + 7) / 8);
 }
 
 int findCompressedDictionarySize(CodeList *codeList, int *charDict) {
-    int size = 1;
-    for(int i = 0; i < codeList->size; i++) {
+    int size = HEADER_SIZE;
+    for(int i = 0; codeList != NULL && i < codeList->size; i++) {
         int key = codeList->root[i].key;
         int keyBytes = numberBytes(charDict[key]);
         size = size + 2 + keyBytes;
@@ -85,21 +233,33 @@ int findCompressedDictionarySize(CodeList *codeList, int *charDict) {
     return size;
 }
 
-int findCompressedTextSize(int *charDict, char *text) {
-    int bits = 0;
-    while(*text != '\0') {
-        int key = *text;
-        bits += numberBits(charDict[key]); 
-        text += 1;
+int findCompressedTextSize(int *charDict, char *text, int length) {
+    int codeBits[256];
+    long long bits = 0;
+
+    for(int i = 0; i < 256; i++) codeBits[i] = numberBits(charDict[i]);
+    for(int i = 0; i < length; i++) {
+        int key = (unsigned char) text[i];
+        bits += codeBits[key];
     }
-    int size = bits / 8 + 1;
+    int size = (int) ((bits + 7) / 8);
     return size;
 }
 
-int compressDictionary(CodeList *codeList, int *charDict, char *compressedText, int index) {
+/*
+* Header layout: symbol count (2 bytes), original length and CRC-32C of the
+* original text (4 bytes each), all little endian, followed by one (key, code
+* bytes, code) entry per symbol. A NULL codeList writes REUSE_TABLE as the
+* count and no entries; the segment is then decoded with the table of the
+* segment before it.
+*/
+int compressDictionary(CodeList *codeList, int *charDict, char *compressedText, int index, int length, unsigned int crc) {
     int bitBytes = 8;
 
-    compressedText[index++] = appendBitsToByte(compressedText + index, codeList->size, bitBytes); // add size of code list
+    index = compressDictionaryCode(compressedText, index, codeList != NULL ? codeList->size : REUSE_TABLE, 2);
+    index = compressDictionaryCode(compressedText, index, length, 4);
+    index = compressDictionaryCode(compressedText, index, (int) crc, 4);
+    if(codeList == NULL) return index;
     
     for(int i = 0; i < codeList->size; i++) {
         int key = codeList->root[i].key;
@@ -114,6 +274,54 @@ int compressDictionary(CodeList *codeList, int *charDict, char *compressedText,
     return index;
 }
 
+int findSeekIndexSize(int length, int granularity) {
+    int entries = granularity > 0 ? (length + granularity - 1) / granularity : 0;
+    return SEEK_INDEX_HEADER_SIZE + entries * SEEK_ENTRY_SIZE;
+}
+
+/*
+* Seek index layout, following the dictionary: granularity (4 bytes), entry
+* count (4 bytes), then for every granularity-th symbol the byte (4 bytes) and
+* bit (1 byte) at which its code starts, relative to the start of the text.
+* seekBits holds those bit offsets, as countSeekBits finds them.
+*/
+int compressSeekIndex(long *seekBits, int entries, int granularity, char *compressedText, int index) {
+    index = compressDictionaryCode(compressedText, index, granularity, 4);
+    index = compressDictionaryCode(compressedText, index, entries, 4);
+
+    for(int i = 0; i < entries; i++) {
+        index = compressDictionaryCode(compressedText, index, (int) (seekBits[i] >> 3), 4);
+        index = compressDictionaryCode(compressedText, index, (int) (seekBits[i] & 7), 1);
+    }
+
+    return index;
+}
+
+/*
+* Counts the bits of text[0..length), which starts at symbol `start` of the
+* whole text. For every granularity-th symbol in it, stores the bits before
+* it, relative to text[0], in seekBits[symbol / granularity]. The text is
+* walked a seek block at a time so the inner loop only sums.
+*/
+long countSeekBits(int *codeBits, char *text, int start, int length, int granularity, long *seekBits) {
+    long bits = 0;
+    int i = 0;
+
+    while(i < length) {
+        long position = (long) start + i;
+        long end = length;
+
+        if(granularity > 0) {
+            if(position % granularity == 0) seekBits[position / granularity] = bits;
+            long next = (position / granularity + 1) * granularity - start;
+            if(next < end) end = next;
+        }
+        for(; i < end; i++) bits += codeBits[(unsigned char) text[i]];
+    }
+
+    return bits;
+}
+
 int compressDictionaryCode(char *compressedText, int index, int value, int numberBytes) {
     int bitBytes = 8;
     int mask = 255;
@@ -126,36 +334,61 @@ int compressDictionaryCode(char *compressedText, int index, int value, int numbe
     return index;
 }
 
-int compressText(int *charDict, char *text, char *compressedText, int index) {
-    int currentBit = 0;
+int compressText(int *charDict, char *text, int length, char *compressedText, int index) {
+    return cpuKernels()->compressText(charDict, text, length, compressedText, index);
+}
 
-    while(*text != '\0') {
-        int key = *text;
-        int code = charDict[key];
-        index = compressTextCode(compressedText, index, currentBit, code);
-        currentBit = (currentBit + numberBits(code)) % 8;
-        text += 1;
+/*
+* Buffers `codesPerFlush` codes between flushes. A flush leaves fewer than 8
+* bits behind, so that is safe while 7 + codesPerFlush * maxBits <= 64; as a
+* constant it lets the compiler unroll the inner loop.
+*/
+static inline int compressTextCodes(int *charDict, int *codeBits, char *text, int length, char *compressedText, int index, const int codesPerFlush) {
+    unsigned long long buffer = 0;
+    int bufferBits = 0;
+    int i = 0;
+
+    for(; i + codesPerFlush <= length; i += codesPerFlush) {
+        for(int j = 0; j < codesPerFlush; j++) {
+            int key = (unsigned char) text[i + j];
+            buffer = (buffer << codeBits[key]) | (unsigned int) charDict[key];
+            bufferBits += codeBits[key];
+        }
+
+        while(bufferBits >= 8) {
+            bufferBits -= 8;
+            compressedText[index++] = (char) (buffer >> bufferBits);
+        }
+    }
+
+    for(; i < length; i++) {
+        int key = (unsigned char) text[i];
+        buffer = (buffer << codeBits[key]) | (unsigned int) charDict[key];
+        bufferBits += codeBits[key];
+
+        while(bufferBits >= 8) {
+            bufferBits -= 8;
+            compressedText[index++] = (char) (buffer >> bufferBits);
+        }
     }
 
+    if(bufferBits > 0) compressedText[index++] = (char) (buffer << (8 - bufferBits));
     return index;
 }
 
-int compressTextCode(char *compressedText, int index, int currentBit, int code) {
-    int bitBytes = 8;
-    int codeBitsLeft = numberBits(code);
-    int numberBitsInByte = bitBytes - currentBit;
-    
+int compressTextScalar(int *charDict, char *text, int length, char *compressedText, int index) {
+    int codeBits[256];
+    int maxBits = 0;
 
-    while(codeBitsLeft >= numberBitsInByte) {
-        int mask = (1 << (codeBitsLeft - numberBitsInByte)) - 1;
-        compressedText[index++] = appendBitsToByte(compressedText + index, code >> (codeBitsLeft - numberBitsInByte), numberBitsInByte);
-        code = code & mask;
-        codeBitsLeft -= numberBitsInByte;
-        numberBitsInByte = 8;
+    for(int i = 0; i < 256; i++) {
+        codeBits[i] = numberBits(charDict[i]);
+        if(codeBits[i] > maxBits) maxBits = codeBits[i];
     }
-    
-    compressedText[index] = appendBitsToByte(compressedText + index, code, codeBitsLeft);
-    return index;
+
+    if(maxBits <= 14) return compressTextCodes(charDict, codeBits, text, length, compressedText, index, 4);
+    if(maxBits <= 18) return compressTextCodes(charDict, codeBits, text, length, compressedText, index, 3);
+    if(maxBits <= 28) return compressTextCodes(charDict, codeBits, text, length, compressedText, index, 2);
+    return compressTextCodes(charDict, codeBits, text, length, compressedText, index, 1);
 }
 
 char appendBitsToByte(char *initial, int value, int shift) {
@@ -163,15 +396,403 @@ char appendBitsToByte(char *initial, int value, int shift) {
 }
 
 void decompressAndWriteToFile(char *compressedFilename, char *uncompressedFilename) {
-    char *compressedText = readFromFile(compressedFilename);
-    int dictionarySize = compressedText[0];
-    int index = 1;
+    FILE *input = fopen(compressedFilename, "rb");
+    FILE *output = NULL;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", compressedFilename);
+        return;
+    }
+
+    output = fopen(uncompressedFilename, "wb");
+    if(output == NULL) {
+        printf("Error while opening file %s\n", uncompressedFilename);
+        fclose(input);
+        return;
+    }
+
+    int decoded = decompressStream(input, output);
+    int written = !ferror(output);
+    if(fclose(output) != 0) written = 0;
+    fclose(input);
+
+    if(!written) printf("Failed to write %s\n", uncompressedFilename);
+    else if(decoded == -1) printf("Corrupt compressed file %s\n", compressedFilename);
+    if(!written || decoded == -1) remove(uncompressedFilename);
+}
+
+/*
+* Decodes from `input` to `output` through a fixed input window and output
+* buffer, so memory stays constant regardless of the archive size. Appended
+* files are decoded segment by segment, in the order of their block index.
+* Like verifyStream, the segments must end exactly where the index says, so
+* trailing bytes or an interrupted append are reported rather than decoded as
+* a shorter text. Returns the decoded length, or -1 if the stream is corrupt.
+*/
+int decompressStream(FILE *input, FILE *output) {
+    BlockIndex *blocks = readBlockIndex(input);
+    long end = 0;
+
+    if(blocks == NULL) return -1;
+    int decoded = decodeSegments(input, 0, blocks->size, output, NULL, &end);
+    if(decoded != findArchivedLength(blocks) || end != blocks->end) decoded = -1;
+
+    freeBlockIndex(blocks);
+    return decoded;
+}
+
+/*
+* Decodes without writing anything, only checksumming the output into *crc.
+* Fails unless the decoded length matches the block index and the segments
+* end exactly where the index says. Returns the decoded length, or -1.
+*/
+int verifyStream(FILE *input, unsigned int *crc) {
+    BlockIndex *blocks = readBlockIndex(input);
+    long end = 0;
+
+    if(blocks == NULL) return -1;
+    int decoded = decodeSegments(input, 0, blocks->size, NULL, crc, &end);
+    if(decoded != findArchivedLength(blocks) || end != blocks->end) decoded = -1;
+
+    freeBlockIndex(blocks);
+    return decoded;
+}
+
+/*
+* Decodes `segments` consecutive segments starting at byte `offset`. Output
+* goes to `output` and/or the checksum `crc`, either of which may be NULL.
+* *end receives the offset just past the last segment.
+*/
+int decodeSegments(FILE *input, long offset, int segments, FILE *output, unsigned int *crc, long *end) {
+    StreamWindow window;
+    char *buffer = malloc(sizeof(char) * STREAM_BUFFER_SIZE);
+    int charDict[256];
+    long bitIndex = 0;
+    int decoded = 0;
+
+    fseek(input, offset, SEEK_SET);
+    window.bytes = malloc(sizeof(char) * STREAM_WINDOW_SIZE);
+    window.length = 0;
+    window.final = 0;
+    window.input = input;
+    memset(charDict, 0, sizeof(int) * 256);
+
+    for(int i = 0; i < segments && decoded != -1; i++) {
+        int length = decompressSegment(&window, &bitIndex, charDict, buffer, output, crc);
+        decoded = length == -1 ? -1 : decoded + length;
+        bitIndex = (bitIndex + 7) & ~7L;
+    }
+    if(end != NULL) *end = ftell(input) - window.length + (bitIndex >> 3);
+
+    free(window.bytes);
+    free(buffer);
+    return decoded;
+}
+
+/*
+* Decodes the segment starting at *bitIndex. The window is refilled before
+* fewer than STREAM_REFILL_THRESHOLD bytes remain, and each pass decodes only
+* as many symbols as are guaranteed to fit in the bytes held. charDict keeps
+* the previous segment's table for segments that reuse it. Fails if the text
+* does not match the checksum in the header. A short write to `output` fails
+* like a corrupt stream; callers tell them apart with ferror.
+*/
+int decompressSegment(StreamWindow *window, long *bitIndex, int *charDict, char *buffer, FILE *output, unsigned int *crc) {
+    DecodeTable *table = NULL;
+    int granularity = 0;
+    int entries = 0;
+    int length = 0;
+    int decoded = 0;
+    int index = 0;
+
+    if(!window->final && window->length - (*bitIndex >> 3) < HEADER_SIZE + MAX_DICTIONARY_SIZE + SEEK_INDEX_HEADER_SIZE) {
+        refillWindow(window, bitIndex);
+    }
+
+    int start = (int) (*bitIndex >> 3);
+    index = decompressDictionaryHeader(window->bytes + start, window->length - start, charDict, &length);
+    if(index == -1 || start + index + SEEK_INDEX_HEADER_SIZE > window->length) return -1;
+    unsigned int stored = findStoredChecksum(window->bytes + start);
+    unsigned int segmentCrc = 0;
+
+    index = decompressSeekIndex(window->bytes + start, index, length, &granularity, &entries);
+    if(index == -1) return -1;
+    index += start;
+    while(index > window->length && !window->final) {
+        index -= window->length;
+        window->length = (int) fread(window->bytes, sizeof(char), STREAM_WINDOW_SIZE, window->input);
+        window->final = window->length < STREAM_WINDOW_SIZE;
+    }
+    if(index > window->length) return -1;
+
+    *bitIndex = (long) index * 8;
+    table = selectDecodeTable(charDict, length);
+
+    while(decoded < length) {
+        int count = length - decoded;
+
+        if(!window->final && window->length - (*bitIndex >> 3) < STREAM_REFILL_THRESHOLD) {
+            refillWindow(window, bitIndex);
+        }
+
+        if(count > STREAM_BUFFER_SIZE) count = STREAM_BUFFER_SIZE;
+        if(!window->final && table->maxBits > 0 && count > ((long) window->length * 8 - *bitIndex) / table->maxBits) {
+            count = (int) (((long) window->length * 8 - *bitIndex) / table->maxBits);
+        }
+
+        if(table->maxBits == 0 || decodeSymbols(table, window->bytes, window->length, bitIndex, buffer, count) != count) {
+            decoded = -1;
+            break;
+        }
+        if(output != NULL && fwrite(buffer, sizeof(char), count, output) != (size_t) count) {
+            decoded = -1;
+            break;
+        }
+        if(crc != NULL) *crc = checksum(*crc, buffer, count);
+        segmentCrc = checksum(segmentCrc, buffer, count);
+        decoded += count;
+    }
+
+    freeDecodeTable(table);
+    return decoded == length && segmentCrc == stored ? decoded : -1;
+}
+
+/*
+* Moves the unread bytes to the front of the window and fills the rest.
+*/
+void refillWindow(StreamWindow *window, long *bitIndex) {
+    int byteIndex = (int) (*bitIndex >> 3);
+
+    memmove(window->bytes, window->bytes + byteIndex, window->length - byteIndex);
+    window->length -= byteIndex;
+    *bitIndex -= (long) byteIndex * 8;
+    window->length += (int) fread(window->bytes + window->length, sizeof(char), STREAM_WINDOW_SIZE - window->length, window->input);
+    window->final = window->length < STREAM_WINDOW_SIZE;
+}
+
+int findDecompressedSize(unsigned char *compressedText) {
+    return decompressDictionaryCode(compressedText + 2, 4);
+}
+
+unsigned int findStoredChecksum(unsigned char *compressedText) {
+    return (unsigned int) decompressDictionaryCode(compressedText + 6, 4);
+}
+
+/*
+* Decodes into caller provided memory of at least findDecompressedSize bytes.
+* Returns the decoded length, or -1 if the stream is corrupt or the text does
+* not match the stored checksum.
+*/
+int decompressToBuffer(unsigned char *compressedText, int compressedSize, char *uncompressedText) {
+    int charDict[256];
+    int length = 0;
+    int index = decompressHeader(compressedText, compressedSize, charDict, &length);
+
+    if(index == -1) return -1;
+    int decoded = decompressText(compressedText, compressedSize, index, charDict, uncompressedText, length);
+    if(decoded == -1 || checksum(0, uncompressedText, decoded) != findStoredChecksum(compressedText)) return -1;
+    return decoded;
+}
+
+/*
+* Reads the header, dictionary and seek index into charDict and length.
+* Returns the index of the first text byte, or -1 if the buffer is too short.
+*/
+int decompressHeader(unsigned char *compressedText, int compressedSize, int *charDict, int *length) {
+    int granularity = 0;
+    int entries = 0;
+
+    memset(charDict, 0, sizeof(int) * 256);
+    int index = decompressDictionaryHeader(compressedText, compressedSize, charDict, length);
+    if(index == -1 || index + SEEK_INDEX_HEADER_SIZE > compressedSize) return -1;
+    index = decompressSeekIndex(compressedText, index, *length, &granularity, &entries);
+    if(index == -1 || index > compressedSize) return -1;
+    return index;
+}
+
+/*
+* Reads the header and dictionary. A segment that reuses the previous table
+* leaves charDict untouched. Returns the index just past the dictionary, or -1
+* if the buffer is too short or malformed.
+*/
+int decompressDictionaryHeader(unsigned char *compressedText, int compressedSize, int *charDict, int *length) {
+    int index = HEADER_SIZE;
+    int dictionarySize = 0;
+
+    if(compressedSize < HEADER_SIZE) return -1;
+
+    dictionarySize = decompressDictionaryCode(compressedText, 2);
+    *length = findDecompressedSize(compressedText);
+    if(dictionarySize == REUSE_TABLE) return HEADER_SIZE;
+    if(dictionarySize > 256) return -1;
+
+    for(int i = 0; i < dictionarySize; i++) {
+        if(index + 2 > compressedSize || compressedText[index + 1] > 4) return -1;
+        index += 2 + compressedText[index + 1];
+    }
+    if(index > compressedSize) return -1;
+
+    memset(charDict, 0, sizeof(int) * 256);
+    return decompressDictionary(compressedText, HEADER_SIZE, charDict, dictionarySize);
+}
+
+/*
+* Decodes `length` bytes starting at uncompressed `offset` into caller provided
+* memory, touching only the seek blocks that overlap the range. Returns the
+* number of bytes extracted (clamped to the end of the text), or -1.
+*/
+int extractRange(unsigned char *compressedText, int compressedSize, int offset, int length, char *uncompressedText) {
+    int totalLength = 0;
+    int indexStart = 0;
     int charDict[256];
+    int granularity = 0;
+    int entries = 0;
+    int block = 0;
+    long bitIndex = 0;
+
     memset(charDict, 0, sizeof(int) * 256);
-    index = decompressDictionary(compressedText, index, charDict, dictionarySize);
-    char *uncompressedText = decompressText(compressedText, index, charDict);
-    writeToFile(uncompressedFilename, uncompressedText, findStringSize(uncompressedText));
+    int index = decompressDictionaryHeader(compressedText, compressedSize, charDict, &totalLength);
+    if(index == -1 || index + SEEK_INDEX_HEADER_SIZE > compressedSize) return -1;
+    indexStart = index;
+    index = decompressSeekIndex(compressedText, index, totalLength, &granularity, &entries);
+    if(index == -1 || index > compressedSize) return -1;
+
+    if(offset < 0 || offset >= totalLength) return 0;
+    if(length > totalLength - offset) length = totalLength - offset;
+
+    if(entries > 0) {
+        block = offset / granularity;
+        bitIndex = findSeekOffset(compressedText + indexStart + SEEK_INDEX_HEADER_SIZE + block * SEEK_ENTRY_SIZE);
+    }
+
+    return decodeRange(charDict, compressedText + index, compressedSize - index, bitIndex, offset - block * granularity, length, uncompressedText);
+}
+
+/*
+* Same as extractRange for a file, which may hold appended segments. Only the
+* block index, the headers and seek entries of the overlapping segments and
+* the compressed bytes of the overlapping seek blocks are read.
+*/
+void extractAndWriteToFile(char *compressedFilename, int offset, int length, char *uncompressedFilename) {
+    FILE *input = fopen(compressedFilename, "rb");
+    BlockIndex *blocks = NULL;
+    char *uncompressedText = NULL;
+    int extracted = 0;
+
+    if(input == NULL) {
+        printf("Error while opening file %s\n", compressedFilename);
+        return;
+    }
+
+    blocks = readBlockIndex(input);
+    if(blocks == NULL) {
+        printf("Corrupt compressed file %s\n", compressedFilename);
+        fclose(input);
+        return;
+    }
+
+    int totalLength = findArchivedLength(blocks);
+    if(offset >= totalLength) length = 0;
+    else if(length > totalLength - offset) length = totalLength - offset;
+    uncompressedText = malloc(sizeof(char) * (length + 1));
+
+    for(int i = 0; i < blocks->size && extracted != -1; i++) {
+        BlockEntry *entry = blocks->entries + i;
+        long segmentEnd = i + 1 < blocks->size ? blocks->entries[i + 1].offset : blocks->end;
+        int first = offset > entry->start ? offset : entry->start;
+        int last = offset + length < entry->start + entry->length ? offset + length : entry->start + entry->length;
+        int charDict[256];
+
+        if(first >= last) continue;
+        memset(charDict, 0, sizeof(int) * 256);
+        if(entry->tableOffset != entry->offset && readSegmentTable(input, entry->tableOffset, charDict) == -1) {
+            extracted = -1;
+            break;
+        }
+
+        int count = extractSegment(input, entry->offset, segmentEnd, charDict, first - entry->start, last - first, uncompressedText + (first - offset));
+        extracted = count == last - first ? extracted + count : -1;
+    }
+
+    if(extracted == length) writeToFile(uncompressedFilename, uncompressedText, length);
+    else printf("Corrupt compressed file %s\n", compressedFilename);
+
     free(uncompressedText);
+    freeBlockIndex(blocks);
+    fclose(input);
+}
+
+/*
+* Extracts from the segment between file offsets segmentOffset and
+* segmentEnd, reading two seek entries and the overlapping blocks.
+*/
+int extractSegment(FILE *input, long segmentOffset, long segmentEnd, int *charDict, int offset, int length, char *uncompressedText) {
+    unsigned char header[HEADER_SIZE + MAX_DICTIONARY_SIZE + SEEK_INDEX_HEADER_SIZE];
+    unsigned char entry[SEEK_ENTRY_SIZE];
+    int granularity = 0;
+    int entries = 0;
+    int totalLength = 0;
+    int extracted = -1;
+
+    fseek(input, segmentOffset, SEEK_SET);
+    int headerSize = (int) fread(header, sizeof(char), sizeof(header), input);
+    int index = decompressDictionaryHeader(header, headerSize, charDict, &totalLength);
+    if(index == -1 || index + SEEK_INDEX_HEADER_SIZE > headerSize) return -1;
+
+    long indexStart = segmentOffset + index;
+    index = decompressSeekIndex(header, index, totalLength, &granularity, &entries);
+    if(index == -1) return -1;
+
+    long textStart = segmentOffset + index;
+    long bitStart = 0;
+    long bitEnd = (segmentEnd - textStart) * 8;
+    int block = 0;
+
+    if(offset + length > totalLength) return -1;
+
+    if(entries > 0 && length > 0) {
+        int endBlock = (offset + length - 1) / granularity + 1;
+        block = offset / granularity;
+
+        fseek(input, indexStart + SEEK_INDEX_HEADER_SIZE + (long) block * SEEK_ENTRY_SIZE, SEEK_SET);
+        if(fread(entry, sizeof(char), SEEK_ENTRY_SIZE, input) == SEEK_ENTRY_SIZE) bitStart = findSeekOffset(entry);
+        if(endBlock < entries) {
+            fseek(input, indexStart + SEEK_INDEX_HEADER_SIZE + (long) endBlock * SEEK_ENTRY_SIZE, SEEK_SET);
+            if(fread(entry, sizeof(char), SEEK_ENTRY_SIZE, input) == SEEK_ENTRY_SIZE) bitEnd = findSeekOffset(entry);
+        }
+    }
+    if(bitEnd < bitStart || bitEnd > (segmentEnd - textStart) * 8) return -1;
+
+    int spanSize = (int) (((bitEnd + 7) >> 3) - (bitStart >> 3));
+    unsigned char *span = malloc(sizeof(char) * (spanSize + 1));
+
+    fseek(input, textStart + (bitStart >> 3), SEEK_SET);
+    spanSize = (int) fread(span, sizeof(char), spanSize, input);
+    extracted = decodeRange(charDict, span, spanSize, bitStart & 7, offset - block * granularity, length, uncompressedText);
+
+    free(span);
+    return extracted;
+}
+
+/*
+* Decodes `skip + length` symbols from bit `bitIndex` of `text`, keeping the
+* last `length`.
+*/
+int decodeRange(int *charDict, unsigned char *text, int textSize, long bitIndex, int skip, int length, char *uncompressedText) {
+    DecodeTable *table = NULL;
+    char *skipped = NULL;
+    int decoded = 0;
+
+    if(length <= 0) return 0;
+
+    table = selectDecodeTable(charDict, skip + length);
+    skipped = malloc(sizeof(char) * (skip + 1));
+    if(decodeSymbols(table, text, textSize, &bitIndex, skipped, skip) != skip) decoded = -1;
+    else decoded = decodeSymbols(table, text, textSize, &bitIndex, uncompressedText, length);
+
+    free(skipped);
+    freeDecodeTable(table);
+    return decoded;
 }
 
 int decompressDictionary(unsigned char *compressedText, int index, int *charDict, int dictionarySize) {
@@ -186,65 +807,273 @@ int decompressDictionary(unsigned char *compressedText, int index, int *charDict
     return index;
 }
 
+/*
+* Reads the granularity and entry count of a segment of `length` bytes.
+* Returns the index just past the seek entries, or -1 unless the count is
+* exactly what compressSeekIndex writes for that granularity, so every entry
+* lookup divides by a positive granularity and stays inside the index.
+*/
+int decompressSeekIndex(unsigned char *compressedText, int index, int length, int *granularity, int *entries) {
+    *granularity = decompressDictionaryCode(compressedText + index, 4);
+    *entries = decompressDictionaryCode(compressedText + index + 4, 4);
+
+    long expected = *granularity > 0 ? ((long) length + *granularity - 1) / *granularity : 0;
+    long end = (long) index + SEEK_INDEX_HEADER_SIZE + (long) *entries * SEEK_ENTRY_SIZE;
+    if(length < 0 || *entries != expected || end > 0x7FFFFFFF) return -1;
+    return (int) end;
+}
+
+long findSeekOffset(unsigned char *entry) {
+    return (long) decompressDictionaryCode(entry, 4) * 8 + entry[4];
+}
+
 int decompressDictionaryCode(unsigned char *compressedText, int bytes) {
     int bitBytes = 8;
-    int value = 0;
+    unsigned int value = 0;
 
     for(int i = 0; i < bytes; i++) {
-        int current = compressedText[i];
+        unsigned int current = compressedText[i];
         value = (current << (bitBytes * i)) + value;
     }
 
-    return value;
+    return (int) value;
 }
 
-char * decompressText(unsigned char *compressedText, int index, int *charDict) {
-    int currentLength = 0;
-    int maxLength = 100;
-    char *uncompressedText = malloc(sizeof(char) * maxLength);
+int decompressText(unsigned char *compressedText, int compressedSize, int index, int *charDict, char *uncompressedText, int length) {
+    DecodeTable *table = selectDecodeTable(charDict, length);
+    long bitIndex = (long) index * 8;
+    int decoded = decodeSymbols(table, compressedText, compressedSize, &bitIndex, uncompressedText, length);
 
-    int currentBit = 7;
-    int currentValue = -1;
-    char foundValue = 0;
+    freeDecodeTable(table);
+    return decoded;
+}
 
-    while(currentValue != 0) {
-        if(currentValue == -1) currentValue = 0;
-        currentValue = (currentValue << 1) + ((compressedText[index] >> currentBit) & 1);
+/*
+* Decodes `length` symbols starting at *position (in bits) and advances it.
+*/
+int decodeSymbols(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    CpuKernels *kernels = cpuKernels();
+
+    if(table->multiEntries != NULL) return kernels->decodeTextMultiSymbol(table, compressedText, compressedSize, position, uncompressedText, length);
+    if(table->width <= 8) return kernels->decodeTextWidth8(table, compressedText, compressedSize, position, uncompressedText, length);
+    if(table->width <= 10) return kernels->decodeTextWidth10(table, compressedText, compressedSize, position, uncompressedText, length);
+    return kernels->decodeTextWidth12(table, compressedText, compressedSize, position, uncompressedText, length);
+}
+
+static inline int loadWindow(unsigned char *compressedText, int compressedSize, long byteIndex) {
+    unsigned char *bytes = compressedText + byteIndex;
+    int window = 0;
+
+    if(byteIndex + 2 < compressedSize) return (bytes[0] << 16) | (bytes[1] << 8) | bytes[2];
+    for(int i = 0; i < 3; i++) {
+        window = window << 8;
+        if(byteIndex + i < compressedSize) window |= bytes[i];
+    }
+
+    return window;
+}
+
+/*
+* Decodes exactly `length` symbols. Codes longer than the window take the
+* slow path. Returns -1 if the stream runs out or holds an unknown code.
+*/
+static inline int decodeTextWidth(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length, const int width) {
+    const int mask = (1 << width) - 1;
+    long bitIndex = *position;
+
+    for(int i = 0; i < length; i++) {
+        int window = loadWindow(compressedText, compressedSize, bitIndex >> 3);
+        int peek = (window >> (24 - (bitIndex & 7) - width)) & mask;
+        DecodeEntry entry = table->entries[peek];
+        int key = entry.key;
+
+        if(entry.bits != 0) bitIndex += entry.bits;
+        else if((key = decodeLongCode(table, compressedText, compressedSize, &bitIndex)) == -1) return -1;
+
+        uncompressedText[i] = (char) key;
+    }
+
+    if(bitIndex > (long) compressedSize * 8) return -1;
+    *position = bitIndex;
+    return length;
+}
+
+int decodeTextWidth8(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidth(table, compressedText, compressedSize, position, uncompressedText, length, 8);
+}
+
+int decodeTextWidth10(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidth(table, compressedText, compressedSize, position, uncompressedText, length, 10);
+}
+
+int decodeTextWidth12(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidth(table, compressedText, compressedSize, position, uncompressedText, length, 12);
+}
+
+/*
+* Copies a whole multi-symbol entry while at least MULTI_SYMBOL_MAX bytes of
+* output remain, and finishes the tail one symbol at a time.
+*/
+int decodeTextMultiSymbol(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    const int width = DECODE_TABLE_MAX_WIDTH;
+    const int mask = (1 << width) - 1;
+    long bitIndex = *position;
+    int i = 0;
+
+    while(i < length) {
+        int window = loadWindow(compressedText, compressedSize, bitIndex >> 3);
+        int peek = (window >> (24 - (bitIndex & 7) - width)) & mask;
+        MultiDecodeEntry multi = table->multiEntries[peek];
+
+        if(multi.count != 0 && i + MULTI_SYMBOL_MAX <= length) {
+            memcpy(uncompressedText + i, multi.keys, MULTI_SYMBOL_MAX);
+            i += multi.count;
+            bitIndex += multi.bits;
+            continue;
+        }
+
+        DecodeEntry entry = table->entries[peek];
+        int key = entry.key;
+
+        if(entry.bits != 0) bitIndex += entry.bits;
+        else if((key = decodeLongCode(table, compressedText, compressedSize, &bitIndex)) == -1) return -1;
+
+        uncompressedText[i] = (char) key;
+        i += 1;
+    }
+
+    if(bitIndex > (long) compressedSize * 8) return -1;
+    *position = bitIndex;
+    return length;
+}
+
+int decodeLongCode(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *bitIndex) {
+    int value = 0;
+    int foundValue = 0;
 
-        if((foundValue = findKeyFromCode(charDict, currentValue)) != 0) {
-            uncompressedText[currentLength] = foundValue;
-            currentLength += 1;
-            currentValue = -1;
+    for(int bits = 1; bits <= table->maxBits; bits++) {
+        long current = *bitIndex + bits - 1;
+        if(current >= (long) compressedSize * 8) return -1;
+        value = (value << 1) + ((compressedText[current >> 3] >> (7 - (current & 7))) & 1);
 
-            if(currentLength == maxLength) {
-                maxLength *= 2;
-                uncompressedText = realloc(uncompressedText, sizeof(char) * maxLength);
-            }
+        if(bits > table->width && (foundValue = findKeyFromCode(table->charDict, value)) != -1) {
+            *bitIndex += bits;
+            return foundValue;
         }
+    }
+
+    return -1;
+}
+
+DecodeTable * buildDecodeTable(int *charDict) {
+    return createDecodeTable(charDict, 0);
+}
+
+DecodeTable * selectDecodeTable(int *charDict, int length) {
+    if(useMultiDecodeTable(charDict, length)) return buildMultiDecodeTable(charDict);
+    return buildDecodeTable(charDict);
+}
+
+/*
+* Each window resolves as many whole codes as fit in its bits, up to
+* MULTI_SYMBOL_MAX. A count of 0 means the first code is longer than the window.
+*/
+DecodeTable * buildMultiDecodeTable(int *charDict) {
+    DecodeTable *table = createDecodeTable(charDict, DECODE_TABLE_MAX_WIDTH);
+    int width = table->width;
+    int mask = (1 << width) - 1;
+    table->multiEntries = calloc(1 << width, sizeof(MultiDecodeEntry));
 
-        if(currentBit == 0) {
-            currentBit = 7;
-            index += 1;
+    for(int peek = 0; peek <= mask; peek++) {
+        MultiDecodeEntry *multi = table->multiEntries + peek;
+
+        while(multi->count < MULTI_SYMBOL_MAX) {
+            DecodeEntry entry = table->entries[(peek << multi->bits) & mask];
+            if(entry.bits == 0 || multi->bits + entry.bits > width) break;
+
+            multi->keys[multi->count] = entry.key;
+            multi->count += 1;
+            multi->bits += entry.bits;
         }
-        else {
-            currentBit -= 1;
+    }
+
+    return table;
+}
+
+/*
+* Code lengths imply symbol probabilities of 2^-length, so the expected code
+* length tells whether a window usually holds at least two symbols.
+*/
+int useMultiDecodeTable(int *charDict, int length) {
+    int precision = 40;
+    long long expectedBits = 0;
+
+    if(length < MULTI_SYMBOL_MIN_LENGTH) return 0;
+
+    for(int i = 0; i < 256; i++) {
+        int bits = numberBits(charDict[i]);
+        if(bits == 0 || bits - 1 > precision) continue;
+        expectedBits += bits * (1LL << (precision - (bits - 1)));
+    }
+
+    return expectedBits * 2 <= ((long long) DECODE_TABLE_MAX_WIDTH << precision);
+}
+
+/*
+* A width of 0 picks the narrowest supported width covering the longest code.
+*/
+DecodeTable * createDecodeTable(int *charDict, int width) {
+    DecodeTable *table = malloc(sizeof(DecodeTable));
+    table->charDict = charDict;
+    table->multiEntries = NULL;
+    table->maxBits = 0;
+
+    for(int i = 0; i < 256; i++) {
+        int bits = numberBits(charDict[i]);
+        if(bits > table->maxBits) table->maxBits = bits;
+    }
+
+    table->width = width;
+    if(width == 0) {
+        table->width = DECODE_TABLE_MIN_WIDTH;
+        while(table->width < table->maxBits && table->width < DECODE_TABLE_MAX_WIDTH) table->width += 2;
+    }
+    table->entries = calloc(1 << table->width, sizeof(DecodeEntry));
+
+    for(int i = 0; i < 256; i++) {
+        int bits = numberBits(charDict[i]);
+        if(bits == 0 || bits > table->width) continue;
+
+        int first = charDict[i] << (table->width - bits);
+        int count = 1 << (table->width - bits);
+        for(int j = 0; j < count; j++) {
+            table->entries[first + j].key = i;
+            table->entries[first + j].bits = bits;
         }
     }
 
-    *(uncompressedText + currentLength) = '\0';
-    uncompressedText = realloc(uncompressedText, sizeof(char)*(currentLength + 1));
-    return uncompressedText;
+    return table;
 }
 
-char findKeyFromCode(int *charDict, int code) {
+void freeDecodeTable(DecodeTable *table) {
+    free(table->multiEntries);
+    free(table->entries);
+    free(table);
+}
+
+int findKeyFromCode(int *charDict, int code) {
     for(int i = 0; i < 256; i++) {
-        if(charDict[i] == code) return (char) i;
+        if(charDict[i] == code) return i;
     }
 
-    return 0;
+    return -1;
 }
 
 int numberBits(int value) {
+    return cpuKernels()->numberBits(value);
+}
+
+int numberBitsScalar(int value) {
     int count = 0;
     while(value != 0) {
         value = value >> 1;
@@ -1,8 +1,51 @@
+#include <pthread.h>
+
+/*
+* Decode tables are indexed by the next `width` bits of the stream. The kernels
+* are specialized per width so the peek/mask arithmetic folds to constants.
+* Multi-symbol tables always use the maximum width and resolve up to
+* MULTI_SYMBOL_MAX short codes per lookup.
+*/
+#define DECODE_TABLE_MIN_WIDTH 8
+#define DECODE_TABLE_MAX_WIDTH 12
+#define MULTI_SYMBOL_MAX 3
+#define MULTI_SYMBOL_MIN_LENGTH 4096
+#define READ_PADDING 4
+#define HEADER_SIZE 10
+#define MAX_DICTIONARY_SIZE (256 * 6)
+#define SEEK_INDEX_HEADER_SIZE 8
+#define SEEK_ENTRY_SIZE 5
+#define SEEK_GRANULARITY (1 << 16)
+#define REUSE_TABLE 0xFFFF
+#define BLOCK_INDEX_MAGIC 0x58494248
+#define BLOCK_ENTRY_SIZE 16
+#define BLOCK_INDEX_TRAILER_SIZE 8
+#define APPEND_REUSE_PERCENT 2
+#define STREAM_WINDOW_SIZE (1 << 16)
+#define STREAM_BUFFER_SIZE (1 << 16)
+#define STREAM_REFILL_THRESHOLD (1 << 12)
+
+/*
+* Kernels are picked once per process from cpuid. Setting CPU_KERNELS_ENV to
+* "scalar" forces the portable kernels.
+*/
+#define CPU_KERNELS_ENV "HUFFMAN_CPU"
+#define CHECKSUM_POLYNOMIAL 0x82F63B78
+
+/*
+* Texts of at least PARALLEL_MIN_LENGTH bytes are encoded by several threads
+* into one bitstream, identical to the serial one. PARALLEL_ENCODE_ENV
+* overrides the thread count; 1 disables it.
+*/
+#define PARALLEL_ENCODE_ENV "HUFFMAN_THREADS"
+#define PARALLEL_MAX_WORKERS 16
+#define PARALLEL_MIN_LENGTH (1 << 20)
+
 /*
 * Struct definitions
 */
 typedef struct CodeNode {
-    char key;
+    int key;
     int freq;
     struct CodeNode *left;
     struct CodeNode *right;
@@ -13,16 +56,123 @@ typedef struct CodeList {
     int size;
 } CodeList;
 
+typedef struct DecodeEntry {
+    unsigned char key;
+    unsigned char bits;
+} DecodeEntry;
+
+typedef struct MultiDecodeEntry {
+    unsigned char keys[MULTI_SYMBOL_MAX];
+    unsigned char count;
+    unsigned char bits;
+} MultiDecodeEntry;
+
+typedef struct DecodeTable {
+    DecodeEntry *entries;
+    MultiDecodeEntry *multiEntries;
+    int *charDict;
+    int width;
+    int maxBits;
+} DecodeTable;
+
+typedef struct StreamWindow {
+    unsigned char *bytes;
+    int length;
+    int final;
+    FILE *input;
+} StreamWindow;
+
+typedef struct BlockEntry {
+    int offset;
+    int tableOffset;
+    int start;
+    int length;
+} BlockEntry;
+
+typedef struct BlockIndex {
+    BlockEntry *entries;
+    int size;
+    int end;
+} BlockIndex;
+
+typedef struct EncodeChunk {
+    int *charDict;
+    int *codeBits;
+    char *text;
+    int start;
+    int length;
+    int granularity;
+    long *seekBits;
+    char *compressedText;
+    long bits;
+    long startBit;
+    long headIndex;
+    char headByte;
+} EncodeChunk;
+
+typedef struct WorkQueue {
+    void *context;
+    void (*work)(void *, int);
+    int count;
+    int next;
+    pthread_mutex_t lock;
+} WorkQueue;
+
+typedef struct CpuKernels {
+    int bmi2;
+    int lzcnt;
+    int sse42;
+    int (*compressText)(int *, char *, int, char *, int);
+    int (*numberBits)(int);
+    int (*decodeTextWidth8)(DecodeTable *, unsigned char *, int, long *, char *, int);
+    int (*decodeTextWidth10)(DecodeTable *, unsigned char *, int, long *, char *, int);
+    int (*decodeTextWidth12)(DecodeTable *, unsigned char *, int, long *, char *, int);
+    int (*decodeTextMultiSymbol)(DecodeTable *, unsigned char *, int, long *, char *, int);
+    unsigned int (*checksum)(unsigned int, char *, int);
+} CpuKernels;
+
 /*
 * Function declarations
 */
-char * readFromFile(char *);
+char * readFromFile(char *, int *);
+char * readTailFromFile(char *, int, int *);
 void writeToFile(char *, char *, int);
-void compressAndWriteToFile(CodeList *, int *, char *, char *);
+void compressAndWriteToFile(CodeList *, int *, char *, int, int, char *);
+int compressToBuffer(CodeList *, int *, char *, int, int, char *);
+int findCompressedSize(CodeList *, int *, char *, int, int);
+int findCountedCompressedSize(CodeList *, int *, int, int);
+long countSeekBits(int *, char *, int, int, int, long *);
 void decompressAndWriteToFile(char *, char *);
+int decompressStream(FILE *, FILE *);
+int verifyStream(FILE *, unsigned int *);
+int decodeSegments(FILE *, long, int, FILE *, unsigned int *, long *);
+int decompressToBuffer(unsigned char *, int, char *);
+int findDecompressedSize(unsigned char *);
+unsigned int findStoredChecksum(unsigned char *);
+int decompressHeader(unsigned char *, int, int *, int *);
+int decompressDictionaryHeader(unsigned char *, int, int *, int *);
+int extractRange(unsigned char *, int, int, int, char *);
+void extractAndWriteToFile(char *, int, int, char *);
 int numberBits(int);
 int numberBytes(int);
 CodeList * duplicateCodeList(CodeList *);
 void freeCodeList(CodeList *);
+DecodeTable * buildDecodeTable(int *);
+DecodeTable * buildMultiDecodeTable(int *);
+int useMultiDecodeTable(int *, int);
+DecodeTable * selectDecodeTable(int *, int);
+int decodeSymbols(DecodeTable *, unsigned char *, int, long *, char *, int);
+void freeDecodeTable(DecodeTable *);
 void printString(char *text);
 int findStringSize(char *);
+BlockIndex * readBlockIndex(FILE *);
+int writeBlockIndex(FILE *, BlockIndex *);
+void freeBlockIndex(BlockIndex *);
+int findArchivedLength(BlockIndex *);
+int readSegmentTable(FILE *, long, int *);
+int appendSegment(FILE *, BlockIndex *, CodeList *, int *, char *, int, int);
+CpuKernels * cpuKernels(void);
+unsigned int checksum(unsigned int, char *, int);
+int findEncodeWorkers(void);
+int compressTextParallel(int *, char *, int, char *, int, int, int, long *, unsigned int *);
+void runWorkers(void *, int, int, void (*)(void *, int));
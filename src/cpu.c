@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "compression.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CPU_X86_KERNELS 1
+#include <cpuid.h>
+#include <immintrin.h>
+#define BMI2_TARGET __attribute__((target("bmi2")))
+#define LZCNT_TARGET __attribute__((target("lzcnt")))
+#define SSE42_TARGET __attribute__((target("sse4.2")))
+#endif
+
+/*
+* Kernel declarations
+*/
+int compressTextScalar(int *, char *, int, char *, int);
+int numberBitsScalar(int);
+int decodeTextWidth8(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth10(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth12(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextMultiSymbol(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeLongCode(DecodeTable *, unsigned char *, int, long *);
+unsigned int checksumScalar(unsigned int, char *, int);
+
+/*
+* Function declarations
+*/
+void detectCpuKernels(void);
+#ifdef CPU_X86_KERNELS
+int compressTextBmi2(int *, char *, int, char *, int);
+int numberBitsLzcnt(int);
+int decodeTextWidth8Bmi2(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth10Bmi2(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextWidth12Bmi2(DecodeTable *, unsigned char *, int, long *, char *, int);
+int decodeTextMultiSymbolBmi2(DecodeTable *, unsigned char *, int, long *, char *, int);
+unsigned int checksumSse42(unsigned int, char *, int);
+#endif
+
+static CpuKernels kernels;
+static pthread_once_t kernelsOnce = PTHREAD_ONCE_INIT;
+
+
+/*
+* Function definitions
+*/
+CpuKernels * cpuKernels(void) {
+    pthread_once(&kernelsOnce, detectCpuKernels);
+    return &kernels;
+}
+
+void detectCpuKernels(void) {
+    char *forced = getenv(CPU_KERNELS_ENV);
+
+    kernels.compressText = compressTextScalar;
+    kernels.numberBits = numberBitsScalar;
+    kernels.decodeTextWidth8 = decodeTextWidth8;
+    kernels.decodeTextWidth10 = decodeTextWidth10;
+    kernels.decodeTextWidth12 = decodeTextWidth12;
+    kernels.decodeTextMultiSymbol = decodeTextMultiSymbol;
+    kernels.checksum = checksumScalar;
+    if(forced != NULL && strcmp(forced, "scalar") == 0) return;
+
+#ifdef CPU_X86_KERNELS
+    unsigned int eax, ebx, ecx, edx;
+
+    if(__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        kernels.bmi2 = (ebx >> 8) & 1;
+    }
+    if(__get_cpuid(1, &eax, &ebx, &ecx, &edx)) kernels.sse42 = (ecx >> 20) & 1;
+    if(__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx)) kernels.lzcnt = (ecx >> 5) & 1;
+
+    if(kernels.lzcnt) kernels.numberBits = numberBitsLzcnt;
+    if(kernels.sse42) kernels.checksum = checksumSse42;
+    if(kernels.bmi2) {
+        kernels.compressText = compressTextBmi2;
+        kernels.decodeTextWidth8 = decodeTextWidth8Bmi2;
+        kernels.decodeTextWidth10 = decodeTextWidth10Bmi2;
+        kernels.decodeTextWidth12 = decodeTextWidth12Bmi2;
+        kernels.decodeTextMultiSymbol = decodeTextMultiSymbolBmi2;
+    }
+#endif
+}
+
+#ifdef CPU_X86_KERNELS
+/*
+* The crc32 instruction implements CRC-32C, the same polynomial as the table.
+*/
+SSE42_TARGET unsigned int checksumSse42(unsigned int crc, char *text, int length) {
+    unsigned long long state = ~crc;
+    int i = 0;
+
+    for(; i + 8 <= length; i += 8) {
+        unsigned long long word;
+        memcpy(&word, text + i, 8);
+        state = _mm_crc32_u64(state, word);
+    }
+    for(; i < length; i++) state = _mm_crc32_u8((unsigned int) state, (unsigned char) text[i]);
+
+    return ~(unsigned int) state;
+}
+
+LZCNT_TARGET int numberBitsLzcnt(int value) {
+    return 32 - (int) _lzcnt_u32((unsigned int) value);
+}
+
+/*
+* Same stream as compressTextScalar, but flushes 32 bits per store instead of
+* one byte at a time. Variable shifts compile to shlx/shrx. A flush leaves
+* fewer than 32 bits behind, so `codesPerFlush` codes fit while
+* 31 + codesPerFlush * maxBits <= 64.
+*/
+static inline BMI2_TARGET int compressTextCodesBmi2(int *charDict, int *codeBits, char *text, int length, char *compressedText, int index, const int codesPerFlush) {
+    unsigned long long buffer = 0;
+    int bufferBits = 0;
+    int i = 0;
+
+    for(; i < length; i += codesPerFlush) {
+        int codes = length - i < codesPerFlush ? length - i : codesPerFlush;
+
+        for(int j = 0; j < codes; j++) {
+            int key = (unsigned char) text[i + j];
+            buffer = (buffer << codeBits[key]) | (unsigned int) charDict[key];
+            bufferBits += codeBits[key];
+        }
+
+        if(bufferBits >= 32) {
+            bufferBits -= 32;
+            unsigned int word = __builtin_bswap32((unsigned int) _bzhi_u64(buffer >> bufferBits, 32));
+            memcpy(compressedText + index, &word, 4);
+            index += 4;
+        }
+    }
+
+    while(bufferBits >= 8) {
+        bufferBits -= 8;
+        compressedText[index++] = (char) (buffer >> bufferBits);
+    }
+    if(bufferBits > 0) compressedText[index++] = (char) (buffer << (8 - bufferBits));
+    return index;
+}
+
+BMI2_TARGET int compressTextBmi2(int *charDict, char *text, int length, char *compressedText, int index) {
+    int codeBits[256];
+    int maxBits = 0;
+
+    for(int i = 0; i < 256; i++) {
+        codeBits[i] = numberBits(charDict[i]);
+        if(codeBits[i] > maxBits) maxBits = codeBits[i];
+    }
+
+    if(maxBits <= 11) return compressTextCodesBmi2(charDict, codeBits, text, length, compressedText, index, 3);
+    if(maxBits <= 16) return compressTextCodesBmi2(charDict, codeBits, text, length, compressedText, index, 2);
+    return compressTextCodesBmi2(charDict, codeBits, text, length, compressedText, index, 1);
+}
+
+static inline BMI2_TARGET unsigned long long loadWindow64(unsigned char *bytes) {
+    unsigned long long window;
+    memcpy(&window, bytes, 8);
+    return __builtin_bswap64(window);
+}
+
+/*
+* Loads 64 bits at a time and decodes from the same load until fewer than
+* `width` bits are left in it. The last 8 bytes of the stream go through the
+* scalar kernel, which does the bounds checks.
+*/
+static inline BMI2_TARGET int decodeTextWidthBmi2(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length, const int width) {
+    long bitIndex = *position;
+    int i = 0;
+
+    while(i < length && (bitIndex >> 3) + 8 <= compressedSize) {
+        unsigned long long window = loadWindow64(compressedText + (bitIndex >> 3));
+        int consumed = bitIndex & 7;
+        int longCode = 0;
+
+        while(consumed <= 64 - width && i < length) {
+            DecodeEntry entry = table->entries[_bzhi_u64(window >> (64 - consumed - width), width)];
+            if(entry.bits == 0) {
+                longCode = 1;
+                break;
+            }
+            uncompressedText[i++] = (char) entry.key;
+            consumed += entry.bits;
+        }
+
+        bitIndex = (bitIndex & ~7L) + consumed;
+        if(longCode) {
+            int key = decodeLongCode(table, compressedText, compressedSize, &bitIndex);
+            if(key == -1) return -1;
+            uncompressedText[i++] = (char) key;
+        }
+    }
+
+    int tail;
+    if(width == 8) tail = decodeTextWidth8(table, compressedText, compressedSize, &bitIndex, uncompressedText + i, length - i);
+    else if(width == 10) tail = decodeTextWidth10(table, compressedText, compressedSize, &bitIndex, uncompressedText + i, length - i);
+    else tail = decodeTextWidth12(table, compressedText, compressedSize, &bitIndex, uncompressedText + i, length - i);
+    if(tail == -1) return -1;
+
+    *position = bitIndex;
+    return length;
+}
+
+BMI2_TARGET int decodeTextWidth8Bmi2(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidthBmi2(table, compressedText, compressedSize, position, uncompressedText, length, 8);
+}
+
+BMI2_TARGET int decodeTextWidth10Bmi2(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidthBmi2(table, compressedText, compressedSize, position, uncompressedText, length, 10);
+}
+
+BMI2_TARGET int decodeTextWidth12Bmi2(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    return decodeTextWidthBmi2(table, compressedText, compressedSize, position, uncompressedText, length, 12);
+}
+
+BMI2_TARGET int decodeTextMultiSymbolBmi2(DecodeTable *table, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    const int width = DECODE_TABLE_MAX_WIDTH;
+    long bitIndex = *position;
+    int i = 0;
+
+    while(i + MULTI_SYMBOL_MAX <= length && (bitIndex >> 3) + 8 <= compressedSize) {
+        unsigned long long window = loadWindow64(compressedText + (bitIndex >> 3));
+        int consumed = bitIndex & 7;
+        int longCode = 0;
+
+        while(consumed <= 64 - width && i + MULTI_SYMBOL_MAX <= length) {
+            int peek = (int) _bzhi_u64(window >> (64 - consumed - width), width);
+            MultiDecodeEntry multi = table->multiEntries[peek];
+
+            if(multi.count != 0) {
+                memcpy(uncompressedText + i, multi.keys, MULTI_SYMBOL_MAX);
+                i += multi.count;
+                consumed += multi.bits;
+                continue;
+            }
+
+            DecodeEntry entry = table->entries[peek];
+            if(entry.bits == 0) {
+                longCode = 1;
+                break;
+            }
+            uncompressedText[i++] = (char) entry.key;
+            consumed += entry.bits;
+        }
+
+        bitIndex = (bitIndex & ~7L) + consumed;
+        if(longCode) {
+            int key = decodeLongCode(table, compressedText, compressedSize, &bitIndex);
+            if(key == -1) return -1;
+            uncompressedText[i++] = (char) key;
+        }
+    }
+
+    if(decodeTextMultiSymbol(table, compressedText, compressedSize, &bitIndex, uncompressedText + i, length - i) == -1) return -1;
+    *position = bitIndex;
+    return length;
+}
+#endif
@@ -0,0 +1,414 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "compression.h"
+#include "daemon.h"
+
+/*
+* Kernel declarations
+*/
+CodeList * textToCharCodes(char *, int);
+int * codeListToCharDict(CodeList *);
+int compressDictionaryCode(char *, int, int, int);
+int decompressDictionaryCode(unsigned char *, int);
+
+/*
+* Function declarations
+*/
+void * workerLoop(void *);
+void serveConnection(Worker *, int);
+int handleRequest(Worker *, int, unsigned int, int, int *);
+int trainRequest(Worker *, unsigned int, int);
+int compressRequest(Worker *, unsigned int, int, int *);
+int decompressRequest(Worker *, unsigned int, int, int *);
+void pushConnection(ConnectionQueue *, int);
+int popConnection(ConnectionQueue *);
+TableCacheEntry * acquireTable(TableCache *, unsigned int);
+TableCacheEntry * storeTable(TableCache *, unsigned int, int *, int);
+void releaseTable(TableCache *, TableCacheEntry *);
+void freeCacheEntry(TableCacheEntry *);
+CodeList * charDictToCodeList(int *);
+int coversText(int *, char *, int);
+int ensureCapacity(void **, int *, int);
+int readFully(int, void *, int);
+int writeFully(int, void *, int);
+
+
+/*
+* Function definitions
+*/
+int runDaemon(char *socketPath, int workerCount) {
+    Daemon *daemon = calloc(1, sizeof(Daemon));
+    struct sockaddr_un address;
+    struct timeval timeout = { DAEMON_IDLE_TIMEOUT, 0 };
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if(server == -1 || strlen(socketPath) >= sizeof(address.sun_path)) {
+        printf("Error while opening socket %s\n", socketPath);
+        return 1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+    unlink(socketPath);
+
+    if(bind(server, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(server, DAEMON_QUEUE_SIZE) == -1) {
+        printf("Error while opening socket %s\n", socketPath);
+        close(server);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    pthread_mutex_init(&daemon->cache.lock, NULL);
+    pthread_mutex_init(&daemon->queue.lock, NULL);
+    pthread_cond_init(&daemon->queue.ready, NULL);
+
+    daemon->workerCount = workerCount > 0 ? workerCount : DAEMON_WORKERS;
+    daemon->workers = calloc(daemon->workerCount, sizeof(Worker));
+    for(int i = 0; i < daemon->workerCount; i++) {
+        Worker *worker = daemon->workers + i;
+        worker->daemon = daemon;
+        if(ensureCapacity((void **) &worker->input, &worker->inputCapacity, DAEMON_ARENA_SIZE) == -1
+            || ensureCapacity((void **) &worker->output, &worker->outputCapacity, DAEMON_ARENA_SIZE) == -1) {
+            printf("Error while allocating worker buffers\n");
+            return 1;
+        }
+        memset(worker->input, 0, DAEMON_ARENA_SIZE);
+        memset(worker->output, 0, DAEMON_ARENA_SIZE);
+        pthread_create(&worker->thread, NULL, workerLoop, worker);
+    }
+
+    while(1) {
+        int client = accept(server, NULL, NULL);
+        if(client == -1) continue;
+
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        pushConnection(&daemon->queue, client);
+    }
+
+    return 0;
+}
+
+void * workerLoop(void *arg) {
+    Worker *worker = arg;
+
+    while(1) {
+        int client = popConnection(&worker->daemon->queue);
+        serveConnection(worker, client);
+        close(client);
+    }
+
+    return NULL;
+}
+
+/*
+* Answers requests until the client closes the connection, sends a request
+* that cannot be framed or stays silent for DAEMON_IDLE_TIMEOUT seconds.
+*/
+void serveConnection(Worker *worker, int client) {
+    unsigned char header[DAEMON_REQUEST_HEADER_SIZE];
+    char response[DAEMON_RESPONSE_HEADER_SIZE];
+
+    while(readFully(client, header, DAEMON_REQUEST_HEADER_SIZE) == 0) {
+        int op = header[0];
+        unsigned int id = (unsigned int) decompressDictionaryCode(header + 1, 4);
+        int length = decompressDictionaryCode(header + 5, 4);
+        int outputLength = 0;
+        int status = DAEMON_STATUS_ERROR;
+
+        if(length < 0 || length > DAEMON_MAX_PAYLOAD) return;
+        if(ensureCapacity((void **) &worker->input, &worker->inputCapacity, length + READ_PADDING) == -1) return;
+        if(readFully(client, worker->input, length) == -1) return;
+        memset(worker->input + length, 0, READ_PADDING);
+
+        status = handleRequest(worker, op, id, length, &outputLength);
+        if(status != DAEMON_STATUS_OK) outputLength = 0;
+
+        response[0] = (char) status;
+        compressDictionaryCode(response, 1, outputLength, 4);
+        if(writeFully(client, response, DAEMON_RESPONSE_HEADER_SIZE) == -1) return;
+        if(writeFully(client, worker->output, outputLength) == -1) return;
+    }
+}
+
+int handleRequest(Worker *worker, int op, unsigned int id, int length, int *outputLength) {
+    if(op == DAEMON_OP_TRAIN) return trainRequest(worker, id, length);
+    if(op == DAEMON_OP_COMPRESS) return compressRequest(worker, id, length, outputLength);
+    if(op == DAEMON_OP_DECOMPRESS) return decompressRequest(worker, id, length, outputLength);
+    return DAEMON_STATUS_ERROR;
+}
+
+int trainRequest(Worker *worker, unsigned int id, int length) {
+    if(id == 0 || length == 0) return DAEMON_STATUS_ERROR;
+
+    CodeList *codeList = textToCharCodes((char *) worker->input, length);
+    int *charDict = codeListToCharDict(codeList);
+    releaseTable(&worker->daemon->cache, storeTable(&worker->daemon->cache, id, charDict, 1));
+
+    freeCodeList(codeList);
+    free(charDict);
+    return DAEMON_STATUS_OK;
+}
+
+/*
+* Uses the cached table for `id` when it has a code for every byte of the
+* payload, and otherwise builds one from the payload. That table is only
+* cached when `id` has no entry yet, so a payload the trained table does not
+* cover never replaces it.
+*/
+int compressRequest(Worker *worker, unsigned int id, int length, int *outputLength) {
+    char *text = (char *) worker->input;
+    TableCacheEntry *entry = id != 0 ? acquireTable(&worker->daemon->cache, id) : NULL;
+    int cached = entry != NULL;
+    CodeList *codeList = NULL;
+    int *charDict = NULL;
+
+    if(entry != NULL && !coversText(entry->charDict, text, length)) {
+        releaseTable(&worker->daemon->cache, entry);
+        entry = NULL;
+    }
+
+    if(entry != NULL) {
+        codeList = charDictToCodeList(entry->charDict);
+    }
+    else {
+        codeList = textToCharCodes(text, length);
+        charDict = codeListToCharDict(codeList);
+        if(id != 0 && !cached) entry = storeTable(&worker->daemon->cache, id, charDict, 0);
+    }
+
+    int *codes = entry != NULL ? entry->charDict : charDict;
+    int size = findCompressedSize(codeList, codes, text, length, SEEK_GRANULARITY);
+    int status = ensureCapacity((void **) &worker->output, &worker->outputCapacity, size) == -1 ? DAEMON_STATUS_ERROR : DAEMON_STATUS_OK;
+    if(status == DAEMON_STATUS_OK) *outputLength = compressToBuffer(codeList, codes, text, length, SEEK_GRANULARITY, worker->output);
+
+    if(entry != NULL) releaseTable(&worker->daemon->cache, entry);
+    freeCodeList(codeList);
+    free(charDict);
+    return status;
+}
+
+/*
+* The container carries its own dictionary; the cache only saves rebuilding
+* the decode table when it matches the one stored for `id`. A mismatch never
+* touches the cache, since `id` may hold a trained table. Every code starts
+* with a 1 bit, so each decoded byte costs at least one bit of payload.
+*/
+int decompressRequest(Worker *worker, unsigned int id, int length, int *outputLength) {
+    int charDict[256];
+    int decodedLength = 0;
+    int index = decompressHeader(worker->input, length, charDict, &decodedLength);
+    TableCacheEntry *entry = NULL;
+    DecodeTable *table = NULL;
+    int decoded = -1;
+
+    if(index == -1 || decodedLength < 0 || decodedLength > (long) (length - index) * 8) return DAEMON_STATUS_ERROR;
+    if(ensureCapacity((void **) &worker->output, &worker->outputCapacity, decodedLength) == -1) return DAEMON_STATUS_ERROR;
+
+    if(id != 0) {
+        entry = acquireTable(&worker->daemon->cache, id);
+        if(entry != NULL && memcmp(entry->charDict, charDict, sizeof(charDict)) != 0) {
+            releaseTable(&worker->daemon->cache, entry);
+            entry = NULL;
+        }
+    }
+    table = entry != NULL ? entry->decodeTable : selectDecodeTable(charDict, decodedLength);
+
+    if(decodedLength == 0 || table->maxBits > 0) {
+        long bitIndex = (long) index * 8;
+        decoded = decodeSymbols(table, worker->input, length, &bitIndex, worker->output, decodedLength);
+    }
+
+    if(entry != NULL) releaseTable(&worker->daemon->cache, entry);
+    else freeDecodeTable(table);
+
+    if(decoded == decodedLength && checksum(0, worker->output, decoded) != findStoredChecksum(worker->input)) decoded = -1;
+    *outputLength = decoded;
+    return decoded == decodedLength ? DAEMON_STATUS_OK : DAEMON_STATUS_ERROR;
+}
+
+void pushConnection(ConnectionQueue *queue, int client) {
+    pthread_mutex_lock(&queue->lock);
+    if(queue->size == DAEMON_QUEUE_SIZE) {
+        pthread_mutex_unlock(&queue->lock);
+        close(client);
+        return;
+    }
+
+    queue->fds[(queue->head + queue->size) % DAEMON_QUEUE_SIZE] = client;
+    queue->size += 1;
+    pthread_cond_signal(&queue->ready);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+int popConnection(ConnectionQueue *queue) {
+    pthread_mutex_lock(&queue->lock);
+    while(queue->size == 0) pthread_cond_wait(&queue->ready, &queue->lock);
+
+    int client = queue->fds[queue->head];
+    queue->head = (queue->head + 1) % DAEMON_QUEUE_SIZE;
+    queue->size -= 1;
+    pthread_mutex_unlock(&queue->lock);
+    return client;
+}
+
+/*
+* Cache entries are reference counted so an entry evicted while a worker is
+* still decoding with it is freed by the last releaseTable.
+*/
+TableCacheEntry * acquireTable(TableCache *cache, unsigned int id) {
+    TableCacheEntry *found = NULL;
+
+    pthread_mutex_lock(&cache->lock);
+    for(int i = 0; i < DAEMON_CACHE_SIZE; i++) {
+        if(cache->entries[i] != NULL && cache->entries[i]->id == id) {
+            found = cache->entries[i];
+            found->references += 1;
+            found->lastUsed = ++cache->clock;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    return found;
+}
+
+/*
+* Replaces the entry for `id`, or the least recently used one when the cache
+* is full. Returns the new entry already acquired. Without `replace`, an
+* existing entry for `id` is kept and NULL is returned.
+*/
+TableCacheEntry * storeTable(TableCache *cache, unsigned int id, int *charDict, int replace) {
+    TableCacheEntry *entry = malloc(sizeof(TableCacheEntry));
+    TableCacheEntry *evicted = NULL;
+    int slot = -1;
+
+    entry->id = id;
+    memcpy(entry->charDict, charDict, sizeof(entry->charDict));
+    entry->decodeTable = selectDecodeTable(entry->charDict, MULTI_SYMBOL_MIN_LENGTH);
+    entry->references = 1;
+    entry->evicted = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    for(int i = 0; i < DAEMON_CACHE_SIZE && slot == -1; i++) {
+        if(cache->entries[i] != NULL && cache->entries[i]->id == id) slot = i;
+    }
+    if(slot != -1 && !replace) {
+        pthread_mutex_unlock(&cache->lock);
+        freeCacheEntry(entry);
+        return NULL;
+    }
+    for(int i = 0; i < DAEMON_CACHE_SIZE && slot == -1; i++) {
+        if(cache->entries[i] == NULL) slot = i;
+    }
+    if(slot == -1) {
+        slot = 0;
+        for(int i = 1; i < DAEMON_CACHE_SIZE; i++) {
+            if(cache->entries[i]->lastUsed < cache->entries[slot]->lastUsed) slot = i;
+        }
+    }
+
+    if(cache->entries[slot] != NULL) {
+        cache->entries[slot]->evicted = 1;
+        if(cache->entries[slot]->references == 0) evicted = cache->entries[slot];
+    }
+    cache->entries[slot] = entry;
+    entry->lastUsed = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+
+    if(evicted != NULL) freeCacheEntry(evicted);
+    return entry;
+}
+
+void releaseTable(TableCache *cache, TableCacheEntry *entry) {
+    int unused = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    entry->references -= 1;
+    unused = entry->evicted && entry->references == 0;
+    pthread_mutex_unlock(&cache->lock);
+
+    if(unused) freeCacheEntry(entry);
+}
+
+void freeCacheEntry(TableCacheEntry *entry) {
+    freeDecodeTable(entry->decodeTable);
+    free(entry);
+}
+
+/*
+* Only the keys matter when writing the dictionary header.
+*/
+CodeList * charDictToCodeList(int *charDict) {
+    CodeList *codes = malloc(sizeof(CodeList));
+    codes->root = malloc(sizeof(CodeNode) * 256);
+    codes->size = 0;
+
+    for(int i = 0; i < 256; i++) {
+        if(charDict[i] == 0) continue;
+        codes->root[codes->size].key = i;
+        codes->root[codes->size].freq = 0;
+        codes->root[codes->size].left = NULL;
+        codes->root[codes->size].right = NULL;
+        codes->size += 1;
+    }
+
+    return codes;
+}
+
+int coversText(int *charDict, char *text, int length) {
+    for(int i = 0; i < length; i++) {
+        if(charDict[(unsigned char) text[i]] == 0) return 0;
+    }
+
+    return 1;
+}
+
+/*
+* Arenas only grow, so a worker stops allocating once it has seen its largest
+* request. Returns -1 and keeps the old buffer if it cannot grow.
+*/
+int ensureCapacity(void **buffer, int *capacity, int size) {
+    if(*buffer != NULL && *capacity >= size) return 0;
+
+    void *grown = realloc(*buffer, size > 0 ? size : 1);
+    if(grown == NULL) return -1;
+    *buffer = grown;
+    *capacity = size;
+    return 0;
+}
+
+int readFully(int fd, void *buffer, int size) {
+    char *current = buffer;
+
+    while(size > 0) {
+        ssize_t count = read(fd, current, size);
+        if(count <= 0) return -1;
+        current += count;
+        size -= (int) count;
+    }
+
+    return 0;
+}
+
+int writeFully(int fd, void *buffer, int size) {
+    char *current = buffer;
+
+    while(size > 0) {
+        ssize_t count = write(fd, current, size);
+        if(count <= 0) return -1;
+        current += count;
+        size -= (int) count;
+    }
+
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include <pthread.h>
+
+/*
+* Daemon protocol. Every message is length prefixed, little endian:
+*
+*   request:  op (1 byte), dictionary id (4 bytes), length (4 bytes), payload
+*   response: status (1 byte), length (4 bytes), payload
+*
+* Ops: 't' trains the table for a dictionary id from the payload, 'c'
+* compresses the payload and 'd' decompresses it. A dictionary id of 0 means
+* "no cached table". A connection may send any number of requests. Each
+* connection holds a worker while open, so one that sends or reads nothing
+* for DAEMON_IDLE_TIMEOUT seconds is closed to free the worker.
+*/
+#define DAEMON_OP_TRAIN 't'
+#define DAEMON_OP_COMPRESS 'c'
+#define DAEMON_OP_DECOMPRESS 'd'
+#define DAEMON_STATUS_OK 0
+#define DAEMON_STATUS_ERROR 1
+#define DAEMON_REQUEST_HEADER_SIZE 9
+#define DAEMON_RESPONSE_HEADER_SIZE 5
+#define DAEMON_MAX_PAYLOAD (1 << 30)
+#define DAEMON_WORKERS 4
+#define DAEMON_QUEUE_SIZE 128
+#define DAEMON_CACHE_SIZE 64
+#define DAEMON_ARENA_SIZE (1 << 20)
+#define DAEMON_IDLE_TIMEOUT 10
+
+/*
+* Struct definitions
+*/
+typedef struct TableCacheEntry {
+    unsigned int id;
+    int charDict[256];
+    DecodeTable *decodeTable;
+    long lastUsed;
+    int references;
+    int evicted;
+} TableCacheEntry;
+
+typedef struct TableCache {
+    TableCacheEntry *entries[DAEMON_CACHE_SIZE];
+    long clock;
+    pthread_mutex_t lock;
+} TableCache;
+
+typedef struct ConnectionQueue {
+    int fds[DAEMON_QUEUE_SIZE];
+    int head;
+    int size;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+} ConnectionQueue;
+
+typedef struct Worker {
+    pthread_t thread;
+    struct Daemon *daemon;
+    unsigned char *input;
+    int inputCapacity;
+    char *output;
+    int outputCapacity;
+} Worker;
+
+typedef struct Daemon {
+    TableCache cache;
+    ConnectionQueue queue;
+    Worker *workers;
+    int workerCount;
+} Daemon;
+
+/*
+* Function declarations
+*/
+int runDaemon(char *, int);
@@ -3,15 +3,25 @@
 #include <string.h>
 
 #include "compression.h"
+#include "daemon.h"
+#include "archive.h"
+#include "token.h"
+#include "verify.h"
+#include "bwt.h"
 
 
 /*
 * Function Definitions
 */
-void huffmanEncode(char *input, char *output);
+void huffmanEncode(char *input, char *output, int granularity);
 void huffmanDecode(char *input, char *output);
-CodeList * textToCharCodes(char *);
-void charFrequency(char *, int *);
+void huffmanEncodeTokens(char *input, char *output);
+void huffmanEncodeBlocks(char *input, char *output);
+void huffmanExtract(char *range, char *input, char *output);
+void huffmanAppend(char *input, char *archive, int granularity);
+int shouldReuseTable(CodeList *, int *, int *, char *, int, int);
+CodeList * textToCharCodes(char *, int);
+void charFrequency(char *, int, int *);
 int obtainValidDictLength(int *);
 CodeNode * frequencyToCodes(int *, int);
 CodeList * buildHuffmanHeap(CodeList *);
@@ -23,36 +33,143 @@ CodeNode * buildHuffmanTree(CodeList *);
 CodeNode heapPop(CodeList *);
 void heapPush(CodeList *, CodeNode);
 int * treeToCharDict(CodeNode *);
+int * codeListToCharDict(CodeList *);
 void codifyTree(CodeNode *, int *, int);
 CodeList * duplicateHuffmanDictionary(CodeList *);
 void freeHuffmanTree(CodeNode *);
 int tagArg(char *);
+int validArgCount(int, int);
 
 
-void huffmanEncode(char *input, char *output) {
-    char *text = readFromFile(input);
-    CodeList *codeList = textToCharCodes(text);
-    CodeList *codeHeap = duplicateCodeList(codeList);
+void huffmanEncode(char *input, char *output, int granularity) {
+    int length = 0;
+    char *text = readFromFile(input, &length);
+    if(text == NULL) return;
 
-    codeHeap = buildHuffmanHeap(codeHeap);
-    CodeNode *root = buildHuffmanTree(codeHeap);
-    int *charDict = treeToCharDict(root);
-    compressAndWriteToFile(codeList, charDict, text, output);
+    CodeList *codeList = textToCharCodes(text, length);
+    int *charDict = codeListToCharDict(codeList);
+    compressAndWriteToFile(codeList, charDict, text, length, granularity, output);
 
-    freeCodeList(codeHeap);
     freeCodeList(codeList);
-    freeHuffmanTree(root);
     free(charDict);
     free(text);
 }
 
 void huffmanDecode(char *input, char *output) {
-    decompressAndWriteToFile(input, output);     
+    if(isArchiveFile(input)) printf("File %s is an archive, use -e or -u\n", input);
+    else if(isTokenFile(input)) decompressTokensAndWriteToFile(input, output);
+    else if(isBlockSortedFile(input)) decompressBlocksAndWriteToFile(input, output);
+    else decompressAndWriteToFile(input, output);
+}
+
+void huffmanEncodeTokens(char *input, char *output) {
+    int length = 0;
+    char *text = readFromFile(input, &length);
+    if(text == NULL) return;
+
+    compressTokensAndWriteToFile(text, length, output);
+    free(text);
+}
+
+void huffmanEncodeBlocks(char *input, char *output) {
+    int length = 0;
+    char *text = readFromFile(input, &length);
+    if(text == NULL) return;
+
+    compressBlocksAndWriteToFile(text, length, output);
+    free(text);
+}
+
+void huffmanExtract(char *range, char *input, char *output) {
+    int offset = 0;
+    int length = 0;
+
+    if(sscanf(range, "%d:%d", &offset, &length) != 2 || offset < 0 || length < 0) {
+        printf("Invalid Arguments\n");
+        return;
+    }
+    if(isArchiveFile(input)) {
+        printf("File %s is an archive, use -e or -u\n", input);
+        return;
+    }
+    if(isTokenFile(input) || isBlockSortedFile(input)) {
+        printf("File %s has no seek index, use -d\n", input);
+        return;
+    }
+    extractAndWriteToFile(input, offset, length, output);
 }
 
-CodeList * textToCharCodes(char *text) {
+/*
+* Encodes only the part of `input` beyond what `archive` already holds, as a
+* new segment appended in place.
+*/
+void huffmanAppend(char *input, char *archive, int granularity) {
+    FILE *file = NULL;
+    BlockIndex *blocks = NULL;
+
+    if(isArchiveFile(archive)) {
+        printf("Cannot append to archive %s\n", archive);
+        return;
+    }
+    if(isTokenFile(archive) || isBlockSortedFile(archive)) {
+        printf("Cannot append to %s, it is not a segment file\n", archive);
+        return;
+    }
+
+    file = fopen(archive, "r+b");
+    if(file == NULL) {
+        printf("Error while opening file %s\n", archive);
+        return;
+    }
+
+    blocks = readBlockIndex(file);
+    if(blocks == NULL) {
+        printf("Corrupt compressed file %s\n", archive);
+        fclose(file);
+        return;
+    }
+
+    int length = 0;
+    char *text = readTailFromFile(input, findArchivedLength(blocks), &length);
+    if(text == NULL) printf("File %s is shorter than archive %s\n", input, archive);
+
+    if(text != NULL && length > 0) {
+        int lastDict[256];
+        CodeList *codeList = textToCharCodes(text, length);
+        int *charDict = codeListToCharDict(codeList);
+        int reuse = readSegmentTable(file, blocks->entries[blocks->size - 1].tableOffset, lastDict) == 0
+            && shouldReuseTable(codeList, charDict, lastDict, text, length, granularity);
+
+        int size = reuse ? appendSegment(file, blocks, NULL, lastDict, text, length, granularity)
+            : appendSegment(file, blocks, codeList, charDict, text, length, granularity);
+        if(size == -1) printf("Failed to write %s\n", archive);
+
+        freeCodeList(codeList);
+        free(charDict);
+    }
+
+    free(text);
+    freeBlockIndex(blocks);
+    if(fclose(file) != 0) printf("Failed to write %s\n", archive);
+}
+
+/*
+* Reusing the last table saves its dictionary, so it wins when it covers every
+* symbol of the tail and costs at most APPEND_REUSE_PERCENT more overall.
+*/
+int shouldReuseTable(CodeList *codeList, int *charDict, int *lastDict, char *text, int length, int granularity) {
+    for(int i = 0; i < codeList->size; i++) {
+        if(lastDict[codeList->root[i].key] == 0) return 0;
+    }
+
+    long long freshSize = findCountedCompressedSize(codeList, charDict, length, granularity);
+    long long reuseSize = findCompressedSize(NULL, lastDict, text, length, granularity);
+    return reuseSize * 100 <= freshSize * (100 + APPEND_REUSE_PERCENT);
+}
+
+CodeList * textToCharCodes(char *text, int textLength) {
     int charDict[256] = {0};
-    charFrequency(text, charDict);
+    charFrequency(text, textLength, charDict);
     int length = obtainValidDictLength(charDict);
     CodeList *codes = malloc(sizeof(CodeList));
     codes->size = length;
@@ -61,12 +178,30 @@ CodeList * textToCharCodes(char *text) {
     return codes;
 }
 
-void charFrequency(char *text, int *charDict) {
-    while(*text != '\0') {
-        int index = *text;
-        charDict[index] += 1;
-        text += 1;
+/*
+* Counts into four tables so consecutive equal bytes do not serialize on one
+* counter, eight bytes per load, then merges the tables.
+*/
+void charFrequency(char *text, int length, int *charDict) {
+    unsigned int counts[4][256];
+    int i = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for(; i + 8 <= length; i += 8) {
+        unsigned long long word;
+        memcpy(&word, text + i, 8);
+        counts[0][word & 0xFF] += 1;
+        counts[1][(word >> 8) & 0xFF] += 1;
+        counts[2][(word >> 16) & 0xFF] += 1;
+        counts[3][(word >> 24) & 0xFF] += 1;
+        counts[0][(word >> 32) & 0xFF] += 1;
+        counts[1][(word >> 40) & 0xFF] += 1;
+        counts[2][(word >> 48) & 0xFF] += 1;
+        counts[3][word >> 56] += 1;
     }
+    for(; i < length; i++) counts[0][(unsigned char) text[i]] += 1;
+
+    for(int j = 0; j < 256; j++) charDict[j] += counts[0][j] + counts[1][j] + counts[2][j] + counts[3][j];
 }
 
 int obtainValidDictLength(int *dict) {
@@ -150,6 +285,8 @@ void swapCodes(CodeNode *codes, int firstIndex, int secondIndex) {
 }
 
 CodeNode * buildHuffmanTree(CodeList *codes) {
+    if(codes->size == 0) return NULL;
+
     while (codes->size > 1) {
         CodeNode *min1 = malloc(sizeof(CodeNode));
         CodeNode *min2 = malloc(sizeof(CodeNode));
@@ -187,12 +324,22 @@ void heapPush(CodeList * codes, CodeNode code) {
 }
 
 int * treeToCharDict(CodeNode *root) {
-    int * charDict = malloc(sizeof(int) * 256);
+    int * charDict = calloc(256, sizeof(int));
     codifyTree(root, charDict, 1);
 
     return charDict;
 }
 
+int * codeListToCharDict(CodeList *codeList) {
+    CodeList *codeHeap = buildHuffmanHeap(duplicateCodeList(codeList));
+    CodeNode *root = buildHuffmanTree(codeHeap);
+    int *charDict = treeToCharDict(root);
+
+    freeCodeList(codeHeap);
+    freeHuffmanTree(root);
+    return charDict;
+}
+
 void codifyTree(CodeNode *root, int *codes, int code) {
     if(root != NULL) {
         codifyTree(root->left, codes, (code << 1) + 1);
@@ -217,18 +364,56 @@ int tagArg(char *arg) {
     
     if(arg[1] == 'c') return 0;
     if(arg[1] == 'd') return 1;
+    if(arg[1] == 'x') return 2;
+    if(arg[1] == 's') return 3;
+    if(arg[1] == 'a') return 4;
+    if(arg[1] == 'r') return 5;
+    if(arg[1] == 'l') return 6;
+    if(arg[1] == 'e') return 7;
+    if(arg[1] == 'u') return 8;
+    if(arg[1] == 'w') return 9;
+    if(arg[1] == 't') return 10;
+    if(arg[1] == 'b') return 11;
     
     return -1;
 }
 
+int validArgCount(int type, int argc) {
+    if(type == 0) return argc == 4 || argc == 5;
+    if(type == 1) return argc == 4;
+    if(type == 2) return argc == 5;
+    if(type == 3) return argc == 3 || argc == 4;
+    if(type == 4) return argc == 4 || argc == 5;
+    if(type == 5) return argc >= 4;
+    if(type == 6) return argc == 3;
+    if(type == 7) return argc == 5;
+    if(type == 8) return argc == 4 || argc == 5;
+    if(type == 9) return argc == 4;
+    if(type == 10) return argc >= 3;
+    if(type == 11) return argc == 4;
+    return 0;
+}
+
+#ifndef HUFFMAN_NO_MAIN
 int main(int argc, char **argv) {
     
     int type = -1;
-    if(argc != 4 || (type = tagArg(argv[1])) == -1) {
+    if(argc < 2 || (type = tagArg(argv[1])) == -1 || !validArgCount(type, argc)) {
         printf("Invalid Arguments\n");
         return 0;
     } 
-    if(type == 0) huffmanEncode(argv[2], argv[3]);
-    else huffmanDecode(argv[2], argv[3]);
+    if(type == 0) huffmanEncode(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : SEEK_GRANULARITY);
+    else if(type == 1) huffmanDecode(argv[2], argv[3]);
+    else if(type == 2) huffmanExtract(argv[2], argv[3], argv[4]);
+    else if(type == 3) return runDaemon(argv[2], argc == 4 ? atoi(argv[3]) : DAEMON_WORKERS);
+    else if(type == 4) huffmanAppend(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : SEEK_GRANULARITY);
+    else if(type == 5) return createArchive(argv[2], argv + 3, argc - 3) != 0;
+    else if(type == 6) listArchive(argv[2]);
+    else if(type == 7) extractArchiveEntry(argv[2], argv[3], argv[4]);
+    else if(type == 8) return extractArchive(argv[2], argv[3], argc == 5 ? atoi(argv[4]) : ARCHIVE_WORKERS) != 0;
+    else if(type == 9) huffmanEncodeTokens(argv[2], argv[3]);
+    else if(type == 10) return verifyFiles(argv + 2, argc - 2, VERIFY_WORKERS) != 0;
+    else huffmanEncodeBlocks(argv[2], argv[3]);
     return 0;
-}
\ No newline at end of file
+}
+#endif
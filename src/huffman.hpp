@@ -0,0 +1,141 @@
+/*
+* Header-only C++20 wrapper over the C library. Link against the sources built
+* with -DHUFFMAN_NO_MAIN, as bench/kernelbench.c is.
+*
+* Encoder and Decoder own their CodeList, dictionary and DecodeTable and free
+* them on destruction. Buffers are passed as spans and sized by the objects,
+* so callers never compute lengths by hand. Errors throw std::runtime_error.
+*
+* Both directions run the C kernels, which are specialized at compile time:
+* decodes per table width (decodeTextWidth8/10/12 and the multi-symbol table)
+* and encodes per maximum code length (compressTextCodes). decodeSymbols and
+* compressText pick the instantiation for each table at run time.
+*/
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <span>
+#include <stdexcept>
+
+extern "C" {
+#include "compression.h"
+
+CodeList * textToCharCodes(char *, int);
+int * codeListToCharDict(CodeList *);
+}
+
+namespace huffman {
+
+/*
+* Deleters for the C allocations
+*/
+struct CodeListDeleter {
+    void operator()(CodeList *codeList) const { freeCodeList(codeList); }
+};
+
+struct DecodeTableDeleter {
+    void operator()(DecodeTable *table) const { freeDecodeTable(table); }
+};
+
+struct MallocDeleter {
+    void operator()(int *pointer) const { std::free(pointer); }
+};
+
+/*
+* Builds a code table from `sample` and writes segments in the format of
+* huff -c. Texts may differ from the sample as long as every byte in them
+* occurs in it.
+*/
+class Encoder {
+public:
+    explicit Encoder(std::span<const char> sample, int granularity = SEEK_GRANULARITY)
+        : codeList(textToCharCodes(const_cast<char *>(sample.data()), checkedLength(sample.size()))),
+          charDict(codeListToCharDict(codeList.get())),
+          granularity(granularity) {}
+
+    /*
+    * Bytes encode(text, ...) writes.
+    */
+    std::size_t compressedSize(std::span<const char> text) const {
+        checkCovered(text);
+        return static_cast<std::size_t>(findCompressedSize(codeList.get(), charDict.get(), const_cast<char *>(text.data()), checkedLength(text.size()), granularity));
+    }
+
+    /*
+    * Writes one segment into `output`, which must hold compressedSize(text)
+    * bytes. Returns the number of bytes written.
+    */
+    std::size_t encode(std::span<const char> text, std::span<char> output) const {
+        if(output.size() < compressedSize(text)) throw std::length_error("huffman: output span too small");
+        return static_cast<std::size_t>(compressToBuffer(codeList.get(), charDict.get(), const_cast<char *>(text.data()), static_cast<int>(text.size()), granularity, output.data()));
+    }
+
+private:
+    void checkCovered(std::span<const char> text) const {
+        for(char symbol : text) {
+            if(charDict.get()[static_cast<unsigned char>(symbol)] == 0) throw std::invalid_argument("huffman: byte missing from the sample");
+        }
+    }
+
+    static int checkedLength(std::size_t size) {
+        if(size > 0x7FFFFFFF) throw std::length_error("huffman: text longer than 2 GB");
+        return static_cast<int>(size);
+    }
+
+    std::unique_ptr<CodeList, CodeListDeleter> codeList;
+    std::unique_ptr<int, MallocDeleter> charDict;
+    int granularity;
+};
+
+/*
+* Reads the header of one segment and builds its decode table once. The span
+* must outlive the decoder.
+*/
+class Decoder {
+public:
+    explicit Decoder(std::span<const unsigned char> segment)
+        : segment(segment), charDict(new int[256]) {
+        if(segment.size() > 0x7FFFFFFF) throw std::length_error("huffman: segment longer than 2 GB");
+        if(segment.size() >= 2 && reusesTable()) throw std::runtime_error("huffman: segment reuses the table of the one before it");
+        textIndex = decompressHeader(bytes(), size(), charDict.get(), &textLength);
+        if(textIndex == -1 || textLength < 0 || textLength > static_cast<long>(size() - textIndex) * 8) throw std::runtime_error("huffman: corrupt segment header");
+        table.reset(selectDecodeTable(charDict.get(), textLength));
+    }
+
+    /*
+    * Bytes decode(...) writes.
+    */
+    std::size_t length() const { return static_cast<std::size_t>(textLength); }
+
+    /*
+    * Decodes the whole segment into `output`, which must hold length() bytes.
+    */
+    std::size_t decode(std::span<char> output) const {
+        long position = static_cast<long>(textIndex) * 8;
+
+        if(output.size() < length()) throw std::length_error("huffman: output span too small");
+        if(textLength == 0) return 0;
+        if(table->maxBits == 0 || decodeSymbols(table.get(), bytes(), size(), &position, output.data(), textLength) != textLength
+            || checksum(0, output.data(), textLength) != findStoredChecksum(bytes())) {
+            throw std::runtime_error("huffman: corrupt segment");
+        }
+        return length();
+    }
+
+private:
+    bool reusesTable() const {
+        return (segment[0] | (segment[1] << 8)) == REUSE_TABLE;
+    }
+
+    unsigned char * bytes() const { return const_cast<unsigned char *>(segment.data()); }
+    int size() const { return static_cast<int>(segment.size()); }
+
+    std::span<const unsigned char> segment;
+    std::unique_ptr<int[]> charDict;
+    std::unique_ptr<DecodeTable, DecodeTableDeleter> table;
+    int textIndex = 0;
+    int textLength = 0;
+};
+
+}
@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "compression.h"
+
+/*
+* Function declarations
+*/
+void * countChunkBits(void *);
+void * encodeChunk(void *);
+void * workQueueLoop(void *);
+
+
+/*
+* Function definitions
+*/
+
+/*
+* Threads to encode with: HUFFMAN_THREADS if set, else the online CPUs, at
+* most PARALLEL_MAX_WORKERS.
+*/
+int findEncodeWorkers(void) {
+    char *forced = getenv(PARALLEL_ENCODE_ENV);
+    long workers = forced != NULL ? atol(forced) : sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(workers < 1) return 1;
+    return workers > PARALLEL_MAX_WORKERS ? PARALLEL_MAX_WORKERS : (int) workers;
+}
+
+/*
+* Writes the same bitstream as compressText using `workers` threads. Each
+* chunk first counts its bits and notes the seek offsets inside it; an
+* exclusive prefix sum gives its starting bit, and every chunk then encodes
+* in place. The first byte of a chunk that starts mid-byte is shared with the
+* chunk before it, so it is OR-ed in after the join. The calling thread
+* computes the checksum of the text into *crc while the chunks encode.
+* seekBits receives the bit offset of every granularity-th symbol, relative
+* to the start of the text, as compressSeekIndex stores them.
+*/
+int compressTextParallel(int *charDict, char *text, int length, char *compressedText, int index, int workers, int granularity, long *seekBits, unsigned int *crc) {
+    EncodeChunk *chunks = malloc(sizeof(EncodeChunk) * workers);
+    pthread_t *threads = malloc(sizeof(pthread_t) * workers);
+    int chunkLength = (length + workers - 1) / workers;
+    int codeBits[256];
+    long bit = (long) index * 8;
+
+    for(int i = 0; i < 256; i++) codeBits[i] = numberBits(charDict[i]);
+
+    for(int i = 0; i < workers; i++) {
+        int start = i * chunkLength < length ? i * chunkLength : length;
+        chunks[i].charDict = charDict;
+        chunks[i].codeBits = codeBits;
+        chunks[i].text = text + start;
+        chunks[i].start = start;
+        chunks[i].length = start + chunkLength < length ? chunkLength : length - start;
+        chunks[i].granularity = granularity;
+        chunks[i].seekBits = seekBits;
+        chunks[i].compressedText = compressedText;
+        pthread_create(threads + i, NULL, countChunkBits, chunks + i);
+    }
+    for(int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+
+    for(int i = 0; i < workers; i++) {
+        chunks[i].startBit = bit;
+        bit += chunks[i].bits;
+        pthread_create(threads + i, NULL, encodeChunk, chunks + i);
+    }
+    *crc = checksum(0, text, length);
+    for(int i = 0; i < workers; i++) pthread_join(threads[i], NULL);
+
+    for(int i = 0; i < workers && granularity > 0; i++) {
+        long first = ((long) chunks[i].start + granularity - 1) / granularity;
+        long last = ((long) chunks[i].start + chunks[i].length + granularity - 1) / granularity;
+        for(long entry = first; entry < last; entry++) seekBits[entry] += chunks[i].startBit - (long) index * 8;
+    }
+
+    for(int i = 0; i < workers; i++) {
+        if(chunks[i].headIndex != -1) compressedText[chunks[i].headIndex] |= chunks[i].headByte;
+    }
+
+    free(threads);
+    free(chunks);
+    return (int) ((bit + 7) >> 3);
+}
+
+void * countChunkBits(void *argument) {
+    EncodeChunk *chunk = argument;
+
+    chunk->bits = countSeekBits(chunk->codeBits, chunk->text, chunk->start, chunk->length, chunk->granularity, chunk->seekBits);
+    return NULL;
+}
+
+/*
+* Starts with startBit % 8 zero bits in the accumulator, so every byte comes
+* out already aligned to its final position.
+*/
+void * encodeChunk(void *argument) {
+    EncodeChunk *chunk = argument;
+    unsigned long long buffer = 0;
+    int bufferBits = (int) (chunk->startBit & 7);
+    long position = chunk->startBit >> 3;
+    long shared = bufferBits != 0 ? position : -1;
+
+    chunk->headIndex = -1;
+    for(int i = 0; i < chunk->length; i++) {
+        int key = (unsigned char) chunk->text[i];
+        buffer = (buffer << chunk->codeBits[key]) | (unsigned int) chunk->charDict[key];
+        bufferBits += chunk->codeBits[key];
+
+        while(bufferBits >= 8) {
+            bufferBits -= 8;
+            char byte = (char) (buffer >> bufferBits);
+            if(position == shared) {
+                chunk->headIndex = position;
+                chunk->headByte = byte;
+            } else {
+                chunk->compressedText[position] = byte;
+            }
+            position += 1;
+        }
+    }
+
+    if(bufferBits > 0) {
+        char byte = (char) (buffer << (8 - bufferBits));
+        if(position == shared) {
+            chunk->headIndex = position;
+            chunk->headByte = byte;
+        } else {
+            chunk->compressedText[position] = byte;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+* Calls work(context, i) for every i below `count` on up to workerCount
+* threads. Threads claim indices one at a time, so uneven items balance out.
+*/
+void runWorkers(void *context, int count, int workerCount, void (*work)(void *, int)) {
+    WorkQueue queue;
+
+    if(workerCount > count) workerCount = count;
+    if(workerCount < 1) return;
+
+    queue.context = context;
+    queue.work = work;
+    queue.count = count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * workerCount);
+    for(int i = 0; i < workerCount; i++) pthread_create(threads + i, NULL, workQueueLoop, &queue);
+    for(int i = 0; i < workerCount; i++) pthread_join(threads[i], NULL);
+
+    free(threads);
+    pthread_mutex_destroy(&queue.lock);
+}
+
+void * workQueueLoop(void *argument) {
+    WorkQueue *queue = argument;
+
+    while(1) {
+        pthread_mutex_lock(&queue->lock);
+        int index = queue->next < queue->count ? queue->next++ : -1;
+        pthread_mutex_unlock(&queue->lock);
+        if(index == -1) break;
+
+        queue->work(queue->context, index);
+    }
+
+    return NULL;
+}
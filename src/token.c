@@ -0,0 +1,618 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compression.h"
+#include "token.h"
+
+/*
+* Kernel declarations
+*/
+CodeList * buildHuffmanHeap(CodeList *);
+CodeNode * buildHuffmanTree(CodeList *);
+void freeHuffmanTree(CodeNode *);
+int compressDictionaryCode(char *, int, int, int);
+int decompressDictionaryCode(unsigned char *, int);
+
+/*
+* Function declarations
+*/
+int tokenClass(unsigned char);
+int nextTokenLength(char *, int, int);
+unsigned int hashToken(char *, int);
+TokenCounter * countTokens(char *, int);
+int findToken(TokenCounter *, char *, int);
+void addToken(TokenCounter *, char *, int);
+void freeTokenCounter(TokenCounter *);
+TokenVocabulary * selectVocabulary(TokenCounter *);
+int compareTokenScore(const void *, const void *);
+int compareTokenBytes(const void *, const void *);
+void freeTokenVocabulary(TokenVocabulary *);
+void countSymbols(TokenCounter *, char *, int, int *);
+void buildCodeLengths(int *, int, int *);
+int assignCodeLengths(CodeNode *, int *, int);
+void buildCanonicalCodes(int *, int, int *);
+int findVocabularySize(TokenVocabulary *);
+int compressVocabulary(TokenVocabulary *, char *, int);
+int compressCodeLengths(int *, int, char *, int);
+int compressTokenText(TokenCounter *, int *, int *, char *, int, char *, int);
+int decompressVocabulary(unsigned char *, int, int, TokenVocabulary **);
+int decompressCodeLengths(unsigned char *, int, int, int *, int);
+TokenDecodeTable * buildTokenDecodeTable(int *, int);
+void freeTokenDecodeTable(TokenDecodeTable *);
+int decodeTokenText(TokenDecodeTable *, TokenVocabulary *, unsigned char *, int, long *, char *, int);
+
+
+/*
+* Function definitions
+*/
+void compressTokensAndWriteToFile(char *text, int length, char *filename) {
+    char *compressedText = NULL;
+    int size = compressTokensToBuffer(text, length, &compressedText);
+
+    writeToFile(filename, compressedText, size);
+    free(compressedText);
+}
+
+/*
+* Tokenizes `text`, keeps the TOKEN_VOCABULARY_MAX tokens that save the most
+* and codes everything else as literal bytes. Allocates *compressedText and
+* returns its size.
+*/
+int compressTokensToBuffer(char *text, int length, char **compressedText) {
+    TokenCounter *counter = countTokens(text, length);
+    TokenVocabulary *vocabulary = selectVocabulary(counter);
+    int alphabet = 256 + vocabulary->size;
+    int *freqs = calloc(alphabet, sizeof(int));
+    int *lengths = calloc(alphabet, sizeof(int));
+    int *codes = calloc(alphabet, sizeof(int));
+    long textBits = 0;
+
+    countSymbols(counter, text, length, freqs);
+    buildCodeLengths(freqs, alphabet, lengths);
+    buildCanonicalCodes(lengths, alphabet, codes);
+    for(int i = 0; i < alphabet; i++) textBits += (long) freqs[i] * lengths[i];
+
+    int size = HEADER_SIZE + findVocabularySize(vocabulary) + (alphabet + 1) / 2 + (int) ((textBits + 7) / 8);
+    *compressedText = calloc(size, sizeof(char));
+
+    int index = compressDictionaryCode(*compressedText, 0, TOKEN_TABLE, 2);
+    index = compressDictionaryCode(*compressedText, index, length, 4);
+    index = compressDictionaryCode(*compressedText, index, (int) checksum(0, text, length), 4);
+    index = compressVocabulary(vocabulary, *compressedText, index);
+    index = compressCodeLengths(lengths, alphabet, *compressedText, index);
+    compressTokenText(counter, codes, lengths, text, length, *compressedText, index);
+
+    free(freqs);
+    free(lengths);
+    free(codes);
+    freeTokenVocabulary(vocabulary);
+    freeTokenCounter(counter);
+    return size;
+}
+
+/*
+* Words are runs of letters, digits and non-ASCII bytes, whitespace is a run
+* of blanks, and every other byte is a punctuation token on its own.
+*/
+int tokenClass(unsigned char c) {
+    if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80) return 1;
+    if(c == ' ' || c == '\n' || c == '\r' || c == '\t') return 2;
+    return 0;
+}
+
+int nextTokenLength(char *text, int index, int length) {
+    int class = tokenClass((unsigned char) text[index]);
+    int end = index + 1;
+
+    if(class == 0) return 1;
+    while(end < length && end - index < TOKEN_MAX_LENGTH && tokenClass((unsigned char) text[end]) == class) end += 1;
+    return end - index;
+}
+
+unsigned int hashToken(char *bytes, int length) {
+    unsigned int hash = 2166136261u;
+    for(int i = 0; i < length; i++) hash = (hash ^ (unsigned char) bytes[i]) * 16777619u;
+    return hash & (TOKEN_HASH_SIZE - 1);
+}
+
+/*
+* Counts every token of two or more bytes in a chained hash table. Single
+* bytes are already symbols of their own.
+*/
+TokenCounter * countTokens(char *text, int length) {
+    TokenCounter *counter = malloc(sizeof(TokenCounter));
+    counter->buckets = malloc(sizeof(int) * TOKEN_HASH_SIZE);
+    counter->capacity = 1024;
+    counter->tokens = malloc(sizeof(Token) * counter->capacity);
+    counter->size = 0;
+    for(int i = 0; i < TOKEN_HASH_SIZE; i++) counter->buckets[i] = -1;
+
+    for(int i = 0; i < length;) {
+        int tokenLength = nextTokenLength(text, i, length);
+        if(tokenLength > 1) addToken(counter, text + i, tokenLength);
+        i += tokenLength;
+    }
+
+    return counter;
+}
+
+int findToken(TokenCounter *counter, char *bytes, int length) {
+    int current = counter->buckets[hashToken(bytes, length)];
+
+    while(current != -1) {
+        Token *token = counter->tokens + current;
+        if(token->length == length && memcmp(token->bytes, bytes, length) == 0) return current;
+        current = token->next;
+    }
+
+    return -1;
+}
+
+void addToken(TokenCounter *counter, char *bytes, int length) {
+    int found = findToken(counter, bytes, length);
+    if(found != -1) {
+        counter->tokens[found].freq += 1;
+        return;
+    }
+
+    if(counter->size == counter->capacity) {
+        counter->capacity *= 2;
+        counter->tokens = realloc(counter->tokens, sizeof(Token) * counter->capacity);
+    }
+
+    unsigned int hash = hashToken(bytes, length);
+    Token *token = counter->tokens + counter->size;
+    token->bytes = bytes;
+    token->length = length;
+    token->freq = 1;
+    token->symbol = -1;
+    token->next = counter->buckets[hash];
+    counter->buckets[hash] = counter->size;
+    counter->size += 1;
+}
+
+void freeTokenCounter(TokenCounter *counter) {
+    free(counter->buckets);
+    free(counter->tokens);
+    free(counter);
+}
+
+/*
+* Ranks tokens by the bytes they replace, keeps the best TOKEN_VOCABULARY_MAX
+* and numbers them in sorted order so the vocabulary front codes well.
+*/
+TokenVocabulary * selectVocabulary(TokenCounter *counter) {
+    Token **ranked = malloc(sizeof(Token *) * (counter->size > 0 ? counter->size : 1));
+    TokenVocabulary *vocabulary = malloc(sizeof(TokenVocabulary));
+    int size = 0;
+    int bytes = 0;
+
+    for(int i = 0; i < counter->size; i++) {
+        if(counter->tokens[i].freq >= TOKEN_MIN_FREQUENCY) ranked[size++] = counter->tokens + i;
+    }
+    qsort(ranked, size, sizeof(Token *), compareTokenScore);
+    if(size > TOKEN_VOCABULARY_MAX) size = TOKEN_VOCABULARY_MAX;
+    qsort(ranked, size, sizeof(Token *), compareTokenBytes);
+
+    for(int i = 0; i < size; i++) bytes += ranked[i]->length;
+    vocabulary->bytes = malloc(sizeof(char) * (bytes > 0 ? bytes : 1));
+    vocabulary->offsets = malloc(sizeof(int) * (size + 1));
+    vocabulary->size = size;
+    vocabulary->offsets[0] = 0;
+
+    for(int i = 0; i < size; i++) {
+        memcpy(vocabulary->bytes + vocabulary->offsets[i], ranked[i]->bytes, ranked[i]->length);
+        vocabulary->offsets[i + 1] = vocabulary->offsets[i] + ranked[i]->length;
+        ranked[i]->symbol = 256 + i;
+    }
+
+    free(ranked);
+    return vocabulary;
+}
+
+int compareTokenScore(const void *first, const void *second) {
+    Token *a = *(Token **) first;
+    Token *b = *(Token **) second;
+    long scoreA = (long) a->freq * (a->length - 1);
+    long scoreB = (long) b->freq * (b->length - 1);
+
+    if(scoreA != scoreB) return scoreA > scoreB ? -1 : 1;
+    return compareTokenBytes(first, second);
+}
+
+int compareTokenBytes(const void *first, const void *second) {
+    Token *a = *(Token **) first;
+    Token *b = *(Token **) second;
+    int shared = a->length < b->length ? a->length : b->length;
+    int order = memcmp(a->bytes, b->bytes, shared);
+
+    return order != 0 ? order : a->length - b->length;
+}
+
+void freeTokenVocabulary(TokenVocabulary *vocabulary) {
+    free(vocabulary->bytes);
+    free(vocabulary->offsets);
+    free(vocabulary);
+}
+
+void countSymbols(TokenCounter *counter, char *text, int length, int *freqs) {
+    for(int i = 0; i < length;) {
+        int tokenLength = nextTokenLength(text, i, length);
+        int found = tokenLength > 1 ? findToken(counter, text + i, tokenLength) : -1;
+
+        if(found != -1 && counter->tokens[found].symbol != -1) freqs[counter->tokens[found].symbol] += 1;
+        else for(int j = 0; j < tokenLength; j++) freqs[(unsigned char) text[i + j]] += 1;
+        i += tokenLength;
+    }
+}
+
+/*
+* Huffman code lengths, flattening the frequencies until no code is longer
+* than TOKEN_MAX_CODE_LENGTH so lengths fit in 4 bits.
+*/
+void buildCodeLengths(int *freqs, int alphabet, int *lengths) {
+    int *scaled = malloc(sizeof(int) * alphabet);
+    memcpy(scaled, freqs, sizeof(int) * alphabet);
+
+    while(1) {
+        CodeList *codes = malloc(sizeof(CodeList));
+        codes->root = malloc(sizeof(CodeNode) * alphabet);
+        codes->size = 0;
+        for(int i = 0; i < alphabet; i++) {
+            if(scaled[i] == 0) continue;
+            codes->root[codes->size].key = i;
+            codes->root[codes->size].freq = scaled[i];
+            codes->root[codes->size].left = NULL;
+            codes->root[codes->size].right = NULL;
+            codes->size += 1;
+        }
+
+        memset(lengths, 0, sizeof(int) * alphabet);
+        CodeNode *root = buildHuffmanTree(buildHuffmanHeap(codes));
+        int maxLength = assignCodeLengths(root, lengths, 0);
+        freeHuffmanTree(root);
+        freeCodeList(codes);
+
+        if(maxLength <= TOKEN_MAX_CODE_LENGTH) break;
+        for(int i = 0; i < alphabet; i++) {
+            if(scaled[i] != 0) scaled[i] = (scaled[i] >> 1) + 1;
+        }
+    }
+
+    free(scaled);
+}
+
+/*
+* A lone symbol still gets a 1-bit code so every symbol costs some bits.
+*/
+int assignCodeLengths(CodeNode *root, int *lengths, int depth) {
+    if(root == NULL) return 0;
+    if(root->key != -1) {
+        lengths[root->key] = depth > 0 ? depth : 1;
+        return lengths[root->key];
+    }
+
+    int left = assignCodeLengths(root->left, lengths, depth + 1);
+    int right = assignCodeLengths(root->right, lengths, depth + 1);
+    return left > right ? left : right;
+}
+
+void buildCanonicalCodes(int *lengths, int alphabet, int *codes) {
+    int counts[TOKEN_MAX_CODE_LENGTH + 2] = {0};
+    int nextCode[TOKEN_MAX_CODE_LENGTH + 2] = {0};
+    int code = 0;
+
+    for(int i = 0; i < alphabet; i++) counts[lengths[i]] += 1;
+    counts[0] = 0;
+    for(int bits = 1; bits <= TOKEN_MAX_CODE_LENGTH; bits++) {
+        code = (code + counts[bits - 1]) << 1;
+        nextCode[bits] = code;
+    }
+    for(int i = 0; i < alphabet; i++) {
+        if(lengths[i] != 0) codes[i] = nextCode[lengths[i]]++;
+    }
+}
+
+int findVocabularySize(TokenVocabulary *vocabulary) {
+    int size = 2;
+    for(int i = 0; i < vocabulary->size; i++) {
+        int length = vocabulary->offsets[i + 1] - vocabulary->offsets[i];
+        int shared = 0;
+        if(i > 0) {
+            int previous = vocabulary->offsets[i] - vocabulary->offsets[i - 1];
+            char *a = vocabulary->bytes + vocabulary->offsets[i - 1];
+            char *b = vocabulary->bytes + vocabulary->offsets[i];
+            while(shared < previous && shared < length && a[shared] == b[shared]) shared += 1;
+        }
+        size += 2 + length - shared;
+    }
+    return size;
+}
+
+int compressVocabulary(TokenVocabulary *vocabulary, char *compressedText, int index) {
+    index = compressDictionaryCode(compressedText, index, vocabulary->size, 2);
+
+    for(int i = 0; i < vocabulary->size; i++) {
+        int length = vocabulary->offsets[i + 1] - vocabulary->offsets[i];
+        char *bytes = vocabulary->bytes + vocabulary->offsets[i];
+        int shared = 0;
+        if(i > 0) {
+            int previous = vocabulary->offsets[i] - vocabulary->offsets[i - 1];
+            char *before = vocabulary->bytes + vocabulary->offsets[i - 1];
+            while(shared < previous && shared < length && before[shared] == bytes[shared]) shared += 1;
+        }
+
+        compressedText[index++] = (char) shared;
+        compressedText[index++] = (char) (length - shared);
+        memcpy(compressedText + index, bytes + shared, length - shared);
+        index += length - shared;
+    }
+
+    return index;
+}
+
+int compressCodeLengths(int *lengths, int alphabet, char *compressedText, int index) {
+    for(int i = 0; i < alphabet; i += 2) {
+        int high = lengths[i];
+        int low = i + 1 < alphabet ? lengths[i + 1] : 0;
+        compressedText[index++] = (char) ((high << 4) | low);
+    }
+
+    return index;
+}
+
+int compressTokenText(TokenCounter *counter, int *codes, int *lengths, char *text, int length, char *compressedText, int index) {
+    unsigned long long buffer = 0;
+    int bufferBits = 0;
+
+    for(int i = 0; i < length;) {
+        int tokenLength = nextTokenLength(text, i, length);
+        int found = tokenLength > 1 ? findToken(counter, text + i, tokenLength) : -1;
+        int symbol = found != -1 ? counter->tokens[found].symbol : -1;
+        int count = symbol != -1 ? 1 : tokenLength;
+
+        for(int j = 0; j < count; j++) {
+            int current = symbol != -1 ? symbol : (unsigned char) text[i + j];
+            buffer = (buffer << lengths[current]) | codes[current];
+            bufferBits += lengths[current];
+
+            while(bufferBits >= 8) {
+                bufferBits -= 8;
+                compressedText[index++] = (char) (buffer >> bufferBits);
+            }
+        }
+        i += tokenLength;
+    }
+
+    if(bufferBits > 0) compressedText[index++] = (char) (buffer << (8 - bufferBits));
+    return index;
+}
+
+void decompressTokensAndWriteToFile(char *compressedFilename, char *uncompressedFilename) {
+    int size = 0;
+    unsigned char *compressedText = (unsigned char *) readFromFile(compressedFilename, &size);
+    if(compressedText == NULL) return;
+
+    int length = findTokenTextLength(compressedText, size);
+    char *text = length >= 0 ? malloc(sizeof(char) * (length > 0 ? length : 1)) : NULL;
+
+    if(text == NULL || decompressTokensToBuffer(compressedText, size, text) != length) {
+        printf("Corrupt compressed file %s\n", compressedFilename);
+    } else {
+        writeToFile(uncompressedFilename, text, length);
+    }
+
+    free(text);
+    free(compressedText);
+}
+
+/*
+* Every symbol costs at least one bit and yields at most TOKEN_MAX_LENGTH
+* bytes, which bounds the length a valid file can claim. Returns the length
+* from the header, or -1 so callers never allocate for an impossible one.
+*/
+int findTokenTextLength(unsigned char *compressedText, int compressedSize) {
+    if(compressedSize < HEADER_SIZE) return -1;
+
+    int length = findDecompressedSize(compressedText);
+    if(length < 0 || length > (long) (compressedSize - HEADER_SIZE) * 8 * TOKEN_MAX_LENGTH) return -1;
+    return length;
+}
+
+/*
+* Decodes into caller provided memory of at least findDecompressedSize bytes.
+* The codes must end in the last byte of the buffer and the text must match
+* the stored checksum. Returns the decoded length, or -1 if the stream is
+* corrupt or followed by trailing bytes.
+*/
+int decompressTokensToBuffer(unsigned char *compressedText, int compressedSize, char *uncompressedText) {
+    TokenVocabulary *vocabulary = NULL;
+    TokenDecodeTable *table = NULL;
+    int decoded = -1;
+
+    if(compressedSize < HEADER_SIZE || decompressDictionaryCode(compressedText, 2) != TOKEN_TABLE) return -1;
+    int length = findDecompressedSize(compressedText);
+    int index = decompressVocabulary(compressedText, compressedSize, HEADER_SIZE, &vocabulary);
+    if(index == -1) return -1;
+
+    int alphabet = 256 + vocabulary->size;
+    int *lengths = malloc(sizeof(int) * alphabet);
+    index = decompressCodeLengths(compressedText, compressedSize, index, lengths, alphabet);
+    if(index != -1 && (table = buildTokenDecodeTable(lengths, alphabet)) != NULL) {
+        long bitIndex = (long) index * 8;
+        decoded = decodeTokenText(table, vocabulary, compressedText, compressedSize, &bitIndex, uncompressedText, length);
+        if(decoded != -1 && (bitIndex + 7) >> 3 != compressedSize) decoded = -1;
+        if(decoded != -1 && checksum(0, uncompressedText, decoded) != findStoredChecksum(compressedText)) decoded = -1;
+        freeTokenDecodeTable(table);
+    }
+
+    free(lengths);
+    freeTokenVocabulary(vocabulary);
+    return decoded;
+}
+
+int decompressVocabulary(unsigned char *compressedText, int compressedSize, int index, TokenVocabulary **result) {
+    if(index + 2 > compressedSize) return -1;
+    int size = decompressDictionaryCode(compressedText + index, 2);
+    index += 2;
+    if(size > TOKEN_VOCABULARY_MAX) return -1;
+
+    TokenVocabulary *vocabulary = malloc(sizeof(TokenVocabulary));
+    vocabulary->bytes = malloc(sizeof(char) * (size * TOKEN_MAX_LENGTH + 1));
+    vocabulary->offsets = malloc(sizeof(int) * (size + 1));
+    vocabulary->size = size;
+    vocabulary->offsets[0] = 0;
+
+    for(int i = 0; i < size; i++) {
+        int previous = i > 0 ? vocabulary->offsets[i] - vocabulary->offsets[i - 1] : 0;
+        int shared = index + 2 <= compressedSize ? compressedText[index] : -1;
+        int suffix = index + 2 <= compressedSize ? compressedText[index + 1] : -1;
+
+        index += 2;
+        if(shared < 0 || shared > previous || shared + suffix > TOKEN_MAX_LENGTH || shared + suffix < 2 || index + suffix > compressedSize) {
+            freeTokenVocabulary(vocabulary);
+            return -1;
+        }
+
+        char *bytes = vocabulary->bytes + vocabulary->offsets[i];
+        memcpy(bytes, bytes - previous, shared);
+        memcpy(bytes + shared, compressedText + index, suffix);
+        vocabulary->offsets[i + 1] = vocabulary->offsets[i] + shared + suffix;
+        index += suffix;
+    }
+
+    *result = vocabulary;
+    return index;
+}
+
+int decompressCodeLengths(unsigned char *compressedText, int compressedSize, int index, int *lengths, int alphabet) {
+    if(index + (alphabet + 1) / 2 > compressedSize) return -1;
+
+    for(int i = 0; i < alphabet; i += 2) {
+        lengths[i] = compressedText[index] >> 4;
+        if(i + 1 < alphabet) lengths[i + 1] = compressedText[index] & 0xF;
+        index += 1;
+    }
+
+    return index;
+}
+
+/*
+* Codes up to TOKEN_DECODE_WIDTH bits resolve with one lookup; longer ones
+* walk the canonical first code of each length. Returns NULL if the lengths
+* do not form a prefix code.
+*/
+TokenDecodeTable * buildTokenDecodeTable(int *lengths, int alphabet) {
+    TokenDecodeTable *table = calloc(1, sizeof(TokenDecodeTable));
+    int *codes = calloc(alphabet, sizeof(int));
+    long kraft = 0;
+    int position = 0;
+
+    for(int i = 0; i < alphabet; i++) {
+        table->counts[lengths[i]] += 1;
+        if(lengths[i] != 0) kraft += 1L << (TOKEN_MAX_CODE_LENGTH - lengths[i]);
+    }
+    if(kraft > 1L << TOKEN_MAX_CODE_LENGTH) {
+        free(codes);
+        free(table);
+        return NULL;
+    }
+
+    table->counts[0] = 0;
+    table->sortedSymbols = malloc(sizeof(unsigned short) * (alphabet > 0 ? alphabet : 1));
+    for(int bits = 1, code = 0; bits <= TOKEN_MAX_CODE_LENGTH; bits++) {
+        code = (code + table->counts[bits - 1]) << 1;
+        table->firstCode[bits] = code;
+        table->firstIndex[bits] = position;
+        for(int i = 0; i < alphabet; i++) {
+            if(lengths[i] == bits) table->sortedSymbols[position++] = (unsigned short) i;
+        }
+    }
+
+    buildCanonicalCodes(lengths, alphabet, codes);
+    for(int i = 0; i < alphabet; i++) {
+        if(lengths[i] == 0 || lengths[i] > TOKEN_DECODE_WIDTH) continue;
+        int shift = TOKEN_DECODE_WIDTH - lengths[i];
+        for(int fill = 0; fill < 1 << shift; fill++) {
+            table->entries[(codes[i] << shift) | fill].symbol = (unsigned short) i;
+            table->entries[(codes[i] << shift) | fill].bits = (unsigned char) lengths[i];
+        }
+    }
+
+    free(codes);
+    return table;
+}
+
+void freeTokenDecodeTable(TokenDecodeTable *table) {
+    free(table->sortedSymbols);
+    free(table);
+}
+
+static inline unsigned int loadTokenWindow(unsigned char *compressedText, int compressedSize, long byteIndex) {
+    unsigned char *bytes = compressedText + byteIndex;
+    unsigned int window = 0;
+
+    if(byteIndex + 3 < compressedSize) return ((unsigned int) bytes[0] << 24) | (bytes[1] << 16) | (bytes[2] << 8) | bytes[3];
+    for(int i = 0; i < 4; i++) {
+        window = window << 8;
+        if(byteIndex + i < compressedSize) window |= bytes[i];
+    }
+
+    return window;
+}
+
+/*
+* Decodes symbols from bit *position until `length` bytes are produced and
+* advances it past the last code. Vocabulary symbols copy their bytes
+* straight from the sorted token table.
+*/
+int decodeTokenText(TokenDecodeTable *table, TokenVocabulary *vocabulary, unsigned char *compressedText, int compressedSize, long *position, char *uncompressedText, int length) {
+    long bitIndex = *position;
+    int written = 0;
+
+    while(written < length) {
+        unsigned int window = loadTokenWindow(compressedText, compressedSize, bitIndex >> 3) << (bitIndex & 7);
+        TokenDecodeEntry entry = table->entries[window >> (32 - TOKEN_DECODE_WIDTH)];
+        int symbol = entry.symbol;
+        int bits = entry.bits;
+
+        if(bits == 0) {
+            for(bits = TOKEN_DECODE_WIDTH + 1; bits <= TOKEN_MAX_CODE_LENGTH; bits++) {
+                int code = (int) (window >> (32 - bits)) - table->firstCode[bits];
+                if(code >= 0 && code < table->counts[bits]) {
+                    symbol = table->sortedSymbols[table->firstIndex[bits] + code];
+                    break;
+                }
+            }
+            if(bits > TOKEN_MAX_CODE_LENGTH) return -1;
+        }
+        bitIndex += bits;
+
+        if(symbol < 256) {
+            uncompressedText[written++] = (char) symbol;
+            continue;
+        }
+
+        int start = vocabulary->offsets[symbol - 256];
+        int tokenLength = vocabulary->offsets[symbol - 255] - start;
+        if(written + tokenLength > length) return -1;
+        memcpy(uncompressedText + written, vocabulary->bytes + start, tokenLength);
+        written += tokenLength;
+    }
+
+    if(bitIndex > (long) compressedSize * 8) return -1;
+    *position = bitIndex;
+    return length;
+}
+
+int isTokenFile(char *filename) {
+    FILE *input = fopen(filename, "rb");
+    unsigned char header[2];
+    int isToken = 0;
+
+    if(input == NULL) return 0;
+    if(fread(header, sizeof(char), 2, input) == 2) isToken = decompressDictionaryCode(header, 2) == TOKEN_TABLE;
+    fclose(input);
+    return isToken;
+}
@@ -0,0 +1,67 @@
+/*
+* Token files use the segment header with TOKEN_TABLE in the symbol count:
+*
+*   header:     TOKEN_TABLE (2 bytes), original length, CRC-32C of the
+*               original text (4 bytes each)
+*   vocabulary: token count (2 bytes), then the tokens in sorted order, each
+*               as shared prefix length, suffix length, suffix (front coded)
+*   lengths:    one 4-bit canonical code length per symbol, two per byte
+*   text:       canonical codes, MSB first
+*
+* Symbols 0-255 are literal bytes, 256 onwards the vocabulary in sorted
+* order. Tokens outside the vocabulary are coded as their literal bytes.
+*/
+#define TOKEN_TABLE 0xFFFE
+#define TOKEN_VOCABULARY_MAX 4096
+#define TOKEN_MIN_FREQUENCY 2
+#define TOKEN_MAX_LENGTH 32
+#define TOKEN_MAX_CODE_LENGTH 15
+#define TOKEN_DECODE_WIDTH 11
+#define TOKEN_HASH_SIZE (1 << 16)
+
+/*
+* Struct definitions
+*/
+typedef struct Token {
+    char *bytes;
+    int length;
+    int freq;
+    int symbol;
+    int next;
+} Token;
+
+typedef struct TokenCounter {
+    int *buckets;
+    Token *tokens;
+    int size;
+    int capacity;
+} TokenCounter;
+
+typedef struct TokenVocabulary {
+    char *bytes;
+    int *offsets;
+    int size;
+} TokenVocabulary;
+
+typedef struct TokenDecodeEntry {
+    unsigned short symbol;
+    unsigned char bits;
+} TokenDecodeEntry;
+
+typedef struct TokenDecodeTable {
+    TokenDecodeEntry entries[1 << TOKEN_DECODE_WIDTH];
+    int firstCode[TOKEN_MAX_CODE_LENGTH + 2];
+    int firstIndex[TOKEN_MAX_CODE_LENGTH + 2];
+    int counts[TOKEN_MAX_CODE_LENGTH + 2];
+    unsigned short *sortedSymbols;
+} TokenDecodeTable;
+
+/*
+* Function declarations
+*/
+void compressTokensAndWriteToFile(char *, int, char *);
+int compressTokensToBuffer(char *, int, char **);
+void decompressTokensAndWriteToFile(char *, char *);
+int decompressTokensToBuffer(unsigned char *, int, char *);
+int findTokenTextLength(unsigned char *, int);
+int isTokenFile(char *);
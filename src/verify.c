@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compression.h"
+#include "archive.h"
+#include "token.h"
+#include "bwt.h"
+#include "verify.h"
+
+/*
+* Function declarations
+*/
+void verifyWork(void *, int);
+void verifyArchive(FILE *, ArchiveDirectory *, char *, VerifyResult *);
+void verifyTokenFile(char *, VerifyResult *);
+void printVerifyResult(char *, VerifyResult *);
+
+
+/*
+* Function definitions
+*/
+
+/*
+* Tests every file on a pool of workers, then prints one line per file in
+* argument order. Returns the number of files that failed.
+*/
+int verifyFiles(char **files, int count, int workerCount) {
+    VerifyJob job;
+    int failures = 0;
+
+    job.files = files;
+    job.results = calloc(count > 0 ? count : 1, sizeof(VerifyResult));
+    runWorkers(&job, count, workerCount > 0 ? workerCount : 1, verifyWork);
+
+    for(int i = 0; i < count; i++) {
+        printVerifyResult(files[i], job.results + i);
+        if(!job.results[i].valid) failures += 1;
+    }
+
+    free(job.results);
+    return failures;
+}
+
+void verifyWork(void *argument, int index) {
+    VerifyJob *job = argument;
+    verifyFile(job->files[index], job->results + index);
+}
+
+/*
+* Archives are checked entry by entry against their directory, segment files
+* through verifyStream and block-sorted files a batch of blocks at a time.
+* None keeps more than a window and one output buffer per worker in memory;
+* only token files are decoded whole.
+*/
+void verifyFile(char *filename, VerifyResult *result) {
+    FILE *input = NULL;
+    ArchiveDirectory *directory = NULL;
+
+    memset(result, 0, sizeof(VerifyResult));
+    if(isTokenFile(filename)) {
+        verifyTokenFile(filename, result);
+        return;
+    }
+
+    input = fopen(filename, "rb");
+    if(input == NULL) return;
+
+    if(isBlockSortedFile(filename)) {
+        long length = decompressBlockStream(input, NULL, &result->checksum);
+        result->valid = length != -1;
+        result->length = length;
+    } else if((directory = readArchiveDirectory(input)) != NULL) {
+        verifyArchive(input, directory, filename, result);
+        freeArchiveDirectory(directory);
+    } else {
+        long length = verifyStream(input, &result->checksum);
+        result->valid = length != -1;
+        result->length = length;
+    }
+
+    fclose(input);
+}
+
+void verifyArchive(FILE *input, ArchiveDirectory *directory, char *filename, VerifyResult *result) {
+    result->valid = 1;
+    result->archive = 1;
+    result->entries = directory->size;
+
+    for(int i = 0; i < directory->size; i++) {
+        ArchiveEntry *entry = directory->entries + i;
+
+        if(verifyArchiveEntry(input, entry) == -1) {
+            printf("Corrupt archive entry %s in %s\n", entry->name, filename);
+            result->valid = 0;
+        }
+        result->length += entry->length;
+    }
+}
+
+/*
+* Token files have no streaming decoder, so they are decoded whole. The
+* output is only allocated once its length is known to fit the input.
+*/
+void verifyTokenFile(char *filename, VerifyResult *result) {
+    int size = 0;
+    unsigned char *compressedText = (unsigned char *) readFromFile(filename, &size);
+    if(compressedText == NULL) return;
+
+    int length = findTokenTextLength(compressedText, size);
+    char *text = length >= 0 ? malloc(sizeof(char) * (length > 0 ? length : 1)) : NULL;
+
+    if(text != NULL && decompressTokensToBuffer(compressedText, size, text) == length) {
+        result->valid = 1;
+        result->length = length;
+        result->checksum = findStoredChecksum(compressedText);
+    }
+
+    free(text);
+    free(compressedText);
+}
+
+void printVerifyResult(char *filename, VerifyResult *result) {
+    if(!result->valid) printf("FAILED %s\n", filename);
+    else if(result->archive) printf("OK %ld bytes, %d entries %s\n", result->length, result->entries, filename);
+    else printf("OK %ld bytes, crc %08x %s\n", result->length, result->checksum, filename);
+}
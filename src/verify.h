@@ -0,0 +1,23 @@
+#define VERIFY_WORKERS 4
+
+/*
+* Struct definitions
+*/
+typedef struct VerifyResult {
+    int valid;
+    long length;
+    unsigned int checksum;
+    int entries;
+    int archive;
+} VerifyResult;
+
+typedef struct VerifyJob {
+    char **files;
+    VerifyResult *results;
+} VerifyJob;
+
+/*
+* Function declarations
+*/
+int verifyFiles(char **, int, int);
+void verifyFile(char *, VerifyResult *);